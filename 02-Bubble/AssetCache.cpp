@@ -0,0 +1,150 @@
+#include <climits>
+#include "AssetCache.h"
+#include "TextureAtlas.h"
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+TextureHandle AssetCache::loadTexture(const string &filename, PixelFormat format)
+{
+	TextureHandle handle = textures.find(filename);
+	Texture *texture;
+
+	if(handle.isValid())
+		return waitFor(textures, handle);
+	texture = new Texture();
+	if(!texture->loadFromFile(filename, format))
+	{
+		delete texture;
+		return handle;
+	}
+
+	return textures.insert(filename, texture);
+}
+
+ProgramHandle AssetCache::loadProgram(const string &vertexFile, const string &fragmentFile, ShaderCache &cache)
+{
+	// Tab cannot appear in a file name, the pair is a single key
+	const string key = vertexFile + "\t" + fragmentFile;
+	ProgramHandle handle = programs.find(key);
+	ShaderProgram *program;
+
+	if(handle.isValid())
+		return handle;
+	program = new ShaderProgram();
+	cache.add(*program, vertexFile, fragmentFile);
+
+	return programs.insert(key, program);
+}
+
+LayerHandle AssetCache::loadLayer(const string &filename)
+{
+	LayerHandle handle = layers.find(filename);
+	TileLayer *layer;
+
+	if(handle.isValid())
+		return waitFor(layers, handle);
+	layer = new TileLayer();
+	if(!layer->loadFromFile(filename))
+	{
+		delete layer;
+		return handle;
+	}
+
+	return layers.insert(filename, layer);
+}
+
+TextureHandle AssetCache::loadTextureAsync(const string &filename, PixelFormat format)
+{
+	TextureHandle handle = textures.find(filename);
+	Texture *texture;
+
+	if(handle.isValid())
+		return handle;
+	texture = new Texture();
+	// Images in the atlas are already uploaded, nothing to wait for
+	if(TextureAtlas::instance().find(filename, *texture))
+		return textures.insert(filename, texture);
+	handle = textures.insert(filename, texture, false);
+	loader.loadTexture(texture, filename, format);
+
+	return handle;
+}
+
+LayerHandle AssetCache::loadLayerAsync(const string &filename)
+{
+	LayerHandle handle = layers.find(filename);
+	TileLayer *layer;
+
+	if(handle.isValid())
+		return handle;
+	layer = new TileLayer();
+	handle = layers.insert(filename, layer, false);
+	loader.loadLayer(layer, filename);
+
+	return handle;
+}
+
+void AssetCache::update(int uploadBudget)
+{
+	AssetLoader::Completed completed;
+
+	loader.update(uploadBudget, completed);
+	for(unsigned int i=0; i<completed.textures.size(); i++)
+		textures.setLoaded(completed.textures[i], false);
+	for(unsigned int i=0; i<completed.failedTextures.size(); i++)
+		textures.setLoaded(completed.failedTextures[i], true);
+	for(unsigned int i=0; i<completed.layers.size(); i++)
+		layers.setLoaded(completed.layers[i], false);
+	for(unsigned int i=0; i<completed.failedLayers.size(); i++)
+		layers.setLoaded(completed.failedLayers[i], true);
+}
+
+// A synchronous load of something requested asynchronously before has to
+// finish it, without an upload budget
+
+template<class T>
+AssetHandle<T> AssetCache::waitFor(AssetPool<T> &pool, AssetHandle<T> handle)
+{
+	PROFILE_SCOPE("AssetCache::waitFor");
+
+	while(!pool.isReady(handle) && !pool.isFailed(handle))
+	{
+		update(INT_MAX);
+		if(!pool.isReady(handle) && !pool.isFailed(handle) && !loader.waitForJob())
+			break;
+	}
+	if(!pool.isReady(handle))
+	{
+		pool.release(handle);
+		return AssetHandle<T>();
+	}
+
+	return handle;
+}
+
+void AssetCache::collectUnused()
+{
+	PROFILE_SCOPE("AssetCache::collectUnused");
+	vector<Texture *> unusedTextures;
+	vector<ShaderProgram *> unusedPrograms;
+	vector<TileLayer *> unusedLayers;
+
+	textures.collect(unusedTextures);
+	programs.collect(unusedPrograms);
+	layers.collect(unusedLayers);
+	for(unsigned int i=0; i<unusedTextures.size(); i++)
+	{
+		unusedTextures[i]->free();
+		delete unusedTextures[i];
+	}
+	for(unsigned int i=0; i<unusedPrograms.size(); i++)
+	{
+		unusedPrograms[i]->free();
+		delete unusedPrograms[i];
+	}
+	for(unsigned int i=0; i<unusedLayers.size(); i++)
+		delete unusedLayers[i];
+}
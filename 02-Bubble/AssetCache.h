@@ -0,0 +1,254 @@
+#ifndef _ASSET_CACHE_INCLUDE
+#define _ASSET_CACHE_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Texture.h"
+#include "ShaderProgram.h"
+#include "ShaderCache.h"
+#include "TileLayer.h"
+#include "AssetLoader.h"
+
+
+using namespace std;
+
+
+// Handles name an asset by its slot in the pool and the generation of that
+// slot. When an asset is freed the generation of its slot changes, so a
+// stale handle finds nothing instead of whatever reuses the slot.
+// Generation 0 is never used, a default constructed handle is invalid.
+
+template<class T>
+struct AssetHandle
+{
+	AssetHandle() : index(0), generation(0) {}
+
+	bool isValid() const { return generation != 0; }
+
+	unsigned int index, generation;
+};
+
+
+// Assets of one type, shared by key (the file they come from) and counted:
+// every handle returned by find() or insert() must be released once.
+// Assets nobody holds stay in the pool until collect() hands them back.
+
+template<class T>
+class AssetPool
+{
+
+public:
+	~AssetPool()
+	{
+		for(unsigned int i=0; i<slots.size(); i++)
+			delete slots[i].asset;
+	}
+
+	// Acquires the asset loaded from key, invalid handle if there is none
+	AssetHandle<T> find(const string &key)
+	{
+		AssetHandle<T> handle;
+		typename unordered_map<string, unsigned int>::const_iterator it = keys.find(key);
+
+		if(it != keys.end())
+		{
+			handle.index = it->second;
+			handle.generation = slots[it->second].generation;
+			slots[it->second].refCount++;
+		}
+		return handle;
+	}
+
+	// Takes ownership of asset, the returned handle holds the first
+	// reference. An asset still loading is not handed out until setReady().
+	AssetHandle<T> insert(const string &key, T *asset, bool bReady = true)
+	{
+		AssetHandle<T> handle;
+		Slot slot;
+
+		if(freeSlots.empty())
+		{
+			slot.generation = 0;
+			slots.push_back(slot);
+			freeSlots.push_back((unsigned int)slots.size() - 1);
+		}
+		handle.index = freeSlots.back();
+		freeSlots.pop_back();
+		slots[handle.index].key = key;
+		slots[handle.index].asset = asset;
+		slots[handle.index].refCount = 1;
+		slots[handle.index].bReady = bReady;
+		slots[handle.index].bFailed = false;
+		handle.generation = ++slots[handle.index].generation;
+		keys[key] = handle.index;
+
+		return handle;
+	}
+
+	T *get(const AssetHandle<T> &handle) const
+	{
+		if(!isReady(handle))
+			return NULL;
+		return slots[handle.index].asset;
+	}
+
+	bool isReady(const AssetHandle<T> &handle) const
+	{
+		return isCurrent(handle) && slots[handle.index].bReady;
+	}
+
+	bool isFailed(const AssetHandle<T> &handle) const
+	{
+		return isCurrent(handle) && slots[handle.index].bFailed;
+	}
+
+	// Ends the load of asset. A failed asset is never ready and leaves the
+	// keys, so loading its file again tries again.
+	void setLoaded(const T *asset, bool bFailed)
+	{
+		for(unsigned int i=0; i<slots.size(); i++)
+		{
+			if(slots[i].asset == asset)
+			{
+				slots[i].bReady = !bFailed;
+				slots[i].bFailed = bFailed;
+				if(bFailed)
+					keys.erase(slots[i].key);
+			}
+		}
+	}
+
+	void release(const AssetHandle<T> &handle)
+	{
+		if(isCurrent(handle) && slots[handle.index].refCount > 0)
+			slots[handle.index].refCount--;
+	}
+
+	// Moves the assets nobody holds to unused, their handles become stale.
+	// Assets still loading are kept, the loader is writing into them.
+	void collect(vector<T *> &unused)
+	{
+		for(unsigned int i=0; i<slots.size(); i++)
+		{
+			if(slots[i].asset != NULL && (slots[i].bReady || slots[i].bFailed) && slots[i].refCount == 0)
+			{
+				unused.push_back(slots[i].asset);
+				if(!slots[i].bFailed)
+					keys.erase(slots[i].key);
+				slots[i].asset = NULL;
+				slots[i].generation++;
+				freeSlots.push_back(i);
+			}
+		}
+	}
+
+	int size() const { return int(keys.size()); }
+
+private:
+	struct Slot
+	{
+		string key;
+		T *asset;
+		unsigned int generation;
+		int refCount;
+		bool bReady, bFailed;
+	};
+
+	bool isCurrent(const AssetHandle<T> &handle) const
+	{
+		return handle.isValid() && handle.index < slots.size() && slots[handle.index].generation == handle.generation && slots[handle.index].asset != NULL;
+	}
+
+private:
+	vector<Slot> slots;
+	vector<unsigned int> freeSlots;
+	unordered_map<string, unsigned int> keys;
+
+};
+
+
+typedef AssetHandle<Texture> TextureHandle;
+typedef AssetHandle<ShaderProgram> ProgramHandle;
+typedef AssetHandle<TileLayer> LayerHandle;
+
+
+// AssetCache loads every texture, shader program and tile layer file once,
+// however many objects use it. Loading something already in the cache just
+// returns another handle to it. Handles are released by whoever loaded
+// them, and collectUnused() frees what is left without users, e.g. after
+// changing level. Only the thread that loads may use the cache.
+// The *Async methods return at once with a handle whose get() is NULL
+// until the asset arrives: the files are read on the loader threads and
+// update(), called once a frame, finishes them on the OpenGL thread.
+
+
+class AssetCache
+{
+
+private:
+	AssetCache() {}
+
+public:
+	static AssetCache &instance()
+	{
+		static AssetCache C;
+
+		return C;
+	}
+
+	// Needs an OpenGL context. Invalid handle if the image cannot be loaded.
+	TextureHandle loadTexture(const string &filename, PixelFormat format);
+	// New programs are added to cache and linked by its build(), together
+	// with the rest of the programs added to it
+	ProgramHandle loadProgram(const string &vertexFile, const string &fragmentFile, ShaderCache &cache);
+	// Does not need OpenGL. Invalid handle if the file cannot be parsed.
+	LayerHandle loadLayer(const string &filename);
+	// Never invalid, a file that cannot be loaded stays not ready
+	TextureHandle loadTextureAsync(const string &filename, PixelFormat format);
+	LayerHandle loadLayerAsync(const string &filename);
+
+	bool isReady(const TextureHandle &handle) const { return textures.isReady(handle); }
+	bool isReady(const LayerHandle &handle) const { return layers.isReady(handle); }
+	// The file could not be loaded, the handle will never be ready
+	bool isFailed(const TextureHandle &handle) const { return textures.isFailed(handle); }
+	bool isFailed(const LayerHandle &handle) const { return layers.isFailed(handle); }
+
+	// Needs the OpenGL context. Completes the loads that have arrived,
+	// uploading at most uploadBudget bytes of texture data.
+	void update(int uploadBudget = ASSET_UPLOAD_BUDGET);
+
+	// NULL if the handle is stale or invalid, or the asset is still loading
+	Texture *get(const TextureHandle &handle) const { return textures.get(handle); }
+	ShaderProgram *get(const ProgramHandle &handle) const { return programs.get(handle); }
+	const TileLayer *get(const LayerHandle &handle) const { return layers.get(handle); }
+
+	void release(const TextureHandle &handle) { textures.release(handle); }
+	void release(const ProgramHandle &handle) { programs.release(handle); }
+	void release(const LayerHandle &handle) { layers.release(handle); }
+
+	// Frees the assets that are not held by anybody. Needs the OpenGL context.
+	void collectUnused();
+	// Frees the OpenGL objects of the loader. Call before the context is
+	// destroyed, the assets themselves die with it.
+	void free() { loader.free(); }
+
+	int textureCount() const { return textures.size(); }
+	int programCount() const { return programs.size(); }
+	int layerCount() const { return layers.size(); }
+
+private:
+	template<class T>
+	AssetHandle<T> waitFor(AssetPool<T> &pool, AssetHandle<T> handle);
+
+private:
+	AssetPool<Texture> textures;
+	AssetPool<ShaderProgram> programs;
+	AssetPool<TileLayer> layers;
+	AssetLoader loader;
+
+};
+
+
+#endif // _ASSET_CACHE_INCLUDE
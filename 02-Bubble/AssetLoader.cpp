@@ -0,0 +1,213 @@
+#include <iostream>
+#include <cstring>
+#include "AssetLoader.h"
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+AssetLoader::AssetLoader()
+{
+	uploading = NULL;
+	nRunning = 0;
+	bQuit = false;
+	pbo = 0;
+}
+
+AssetLoader::~AssetLoader()
+{
+	{
+		lock_guard<mutex> guard(lock);
+		bQuit = true;
+	}
+	workAvailable.notify_all();
+	for(unsigned int i=0; i<workers.size(); i++)
+		workers[i].join();
+	for(unsigned int i=0; i<pending.size(); i++)
+		delete pending[i];
+	for(unsigned int i=0; i<done.size(); i++)
+		delete done[i];
+	delete uploading;
+}
+
+
+void AssetLoader::loadTexture(Texture *texture, const string &filename, PixelFormat format)
+{
+	Job *job = new Job();
+
+	job->type = JOB_TEXTURE;
+	job->filename = filename;
+	job->texture = texture;
+	job->layer = NULL;
+	job->format = format;
+	job->uploadedRows = 0;
+	job->bFailed = false;
+	push(job);
+}
+
+void AssetLoader::loadLayer(TileLayer *layer, const string &filename)
+{
+	Job *job = new Job();
+
+	job->type = JOB_LAYER;
+	job->filename = filename;
+	job->texture = NULL;
+	job->layer = layer;
+	job->uploadedRows = 0;
+	job->bFailed = false;
+	push(job);
+}
+
+void AssetLoader::push(Job *job)
+{
+	{
+		lock_guard<mutex> guard(lock);
+		pending.push_back(job);
+		if(workers.empty())
+			for(int i=0; i<ASSET_LOADER_WORKERS; i++)
+				workers.push_back(thread(&AssetLoader::run, this));
+	}
+	workAvailable.notify_one();
+}
+
+// Textures are finished in the order their images were decoded, one at a
+// time, so a texture becomes usable as soon as possible
+
+void AssetLoader::update(int budget, Completed &completed)
+{
+	PROFILE_SCOPE("AssetLoader::update");
+	int uploaded = 0;
+
+	while(true)
+	{
+		if(uploading == NULL)
+		{
+			Job *job;
+
+			{
+				lock_guard<mutex> guard(lock);
+				if(done.empty())
+					break;
+				job = done.front();
+				done.pop_front();
+			}
+			if(job->bFailed)
+			{
+				cout << "Cannot load " << job->filename << endl;
+				if(job->type == JOB_LAYER)
+					completed.failedLayers.push_back(job->layer);
+				else
+					completed.failedTextures.push_back(job->texture);
+				delete job;
+				continue;
+			}
+			if(job->type == JOB_LAYER)
+			{
+				completed.layers.push_back(job->layer);
+				delete job;
+				continue;
+			}
+			job->texture->allocate(job->image.size().x, job->image.size().y, job->format);
+			uploading = job;
+		}
+
+		int rowBytes = (uploading->format == TEXTURE_PIXEL_FORMAT_RGB ? 3 : 4) * uploading->image.size().x;
+
+		// Only the first row of the frame may go over the budget
+		if(uploaded >= budget || (uploaded > 0 && budget - uploaded < rowBytes))
+			break;
+		int rows = glm::clamp((budget - uploaded) / rowBytes, 1, uploading->image.size().y - uploading->uploadedRows);
+
+		uploadRows(*uploading, rows);
+		uploaded += rows * rowBytes;
+		if(uploading->uploadedRows == uploading->image.size().y)
+		{
+			completed.textures.push_back(uploading->texture);
+			delete uploading;
+			uploading = NULL;
+		}
+	}
+}
+
+bool AssetLoader::waitForJob()
+{
+	unique_lock<mutex> guard(lock);
+
+	if(uploading != NULL)
+		return true;
+	while(done.empty() && (!pending.empty() || nRunning > 0))
+		jobDone.wait(guard);
+
+	return !done.empty();
+}
+
+void AssetLoader::free()
+{
+	if(pbo != 0)
+		glDeleteBuffers(1, &pbo);
+	pbo = 0;
+}
+
+void AssetLoader::run()
+{
+	while(true)
+	{
+		Job *job;
+
+		{
+			unique_lock<mutex> guard(lock);
+
+			while(pending.empty() && !bQuit)
+				workAvailable.wait(guard);
+			if(bQuit)
+				return;
+			job = pending.front();
+			pending.pop_front();
+			nRunning++;
+		}
+		if(job->type == JOB_TEXTURE)
+			job->bFailed = !job->image.load(job->filename, job->format);
+		else
+			job->bFailed = !job->layer->loadFromFile(job->filename);
+		{
+			lock_guard<mutex> guard(lock);
+			done.push_back(job);
+			nRunning--;
+		}
+		jobDone.notify_all();
+	}
+}
+
+// The rows are copied into the pixel buffer, orphaned every time so the
+// driver never waits for the previous upload, and the texture is updated
+// from it while the copy to the GPU happens in the background
+
+void AssetLoader::uploadRows(Job &job, int rows)
+{
+	int channels = job.format == TEXTURE_PIXEL_FORMAT_RGB ? 3 : 4;
+	GLsizeiptr bytes = GLsizeiptr(channels) * job.image.size().x * rows;
+	const unsigned char *src = job.image.pixels() + size_t(channels) * job.image.size().x * job.uploadedRows;
+	void *data;
+
+	if(pbo == 0)
+		glGenBuffers(1, &pbo);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+	data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if(data != NULL)
+	{
+		memcpy(data, src, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		// With a pixel buffer bound the pointer is an offset into it
+		job.texture->uploadRows(job.uploadedRows, rows, job.format, (const void *)0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	else
+	{
+		// Could not map the buffer, upload straight from memory
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		job.texture->uploadRows(job.uploadedRows, rows, job.format, src);
+	}
+	job.uploadedRows += rows;
+}
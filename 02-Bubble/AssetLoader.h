@@ -0,0 +1,95 @@
+#ifndef _ASSET_LOADER_INCLUDE
+#define _ASSET_LOADER_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "Texture.h"
+#include "TileLayer.h"
+#include "ImageFile.h"
+
+
+#define ASSET_LOADER_WORKERS 2
+#define ASSET_UPLOAD_BUDGET (1 << 20) // Bytes of texture data uploaded per frame
+
+
+using namespace std;
+
+
+// AssetLoader maps or decodes images (see ImageFile) and parses tile layer files on worker threads,
+// started the first time something is requested. Decoded images wait for
+// the OpenGL thread, which streams them into their textures through a pixel
+// buffer object a few rows at a time, so that a frame never uploads more
+// than its budget. AssetCache owns the loader, see its *Async methods.
+
+
+class AssetLoader
+{
+
+public:
+	// Assets finished by update(), whether they could be loaded or not
+	struct Completed
+	{
+		vector<Texture *> textures, failedTextures;
+		vector<TileLayer *> layers, failedLayers;
+	};
+
+public:
+	AssetLoader();
+	~AssetLoader();
+
+	// The asset must stay alive until update() reports it finished
+	void loadTexture(Texture *texture, const string &filename, PixelFormat format);
+	void loadLayer(TileLayer *layer, const string &filename);
+
+	// OpenGL thread. Uploads at most budget bytes (at least one row) and
+	// appends every asset completed since the last call.
+	void update(int budget, Completed &completed);
+	// Blocks until a job is ready for update(). False if there are none left.
+	bool waitForJob();
+	// OpenGL thread, before the context goes away. Deletes the pixel
+	// buffer, the next upload creates it again.
+	void free();
+
+private:
+	enum JobType
+	{
+		JOB_TEXTURE, JOB_LAYER
+	};
+
+	struct Job
+	{
+		JobType type;
+		string filename;
+		Texture *texture;
+		TileLayer *layer;
+		PixelFormat format;
+		ImageFile image;      // Mapped or decoded by the worker
+		int uploadedRows;
+		bool bFailed;
+	};
+
+	void push(Job *job);
+	void run();
+	void uploadRows(Job &job, int rows);
+
+private:
+	vector<thread> workers;
+	mutex lock;
+	condition_variable workAvailable, jobDone;
+	deque<Job *> pending;   // Waiting for a worker
+	deque<Job *> done;      // Decoded or parsed, waiting for update()
+	Job *uploading;         // Partially uploaded texture, only seen by the OpenGL thread
+	int nRunning;
+	bool bQuit;
+	GLuint pbo;
+
+};
+
+
+#endif // _ASSET_LOADER_INCLUDE
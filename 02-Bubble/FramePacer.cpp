@@ -0,0 +1,183 @@
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include "FramePacer.h"
+#include "Profiler.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+
+using namespace std;
+
+
+#define UNFOCUSED_FRAMERATE 30.0  // Framerate cap while the window is in the background
+#define ICONIFIED_FRAMERATE 10.0  // Framerate cap while the window is minimized
+#define MAX_SLEEP_SAMPLES 1000    // Older sleep measurements fade out after this many
+
+
+FramePacer::FramePacer()
+{
+	window = NULL;
+	mode = PACING_CAPPED;
+	timePerFrame = 0.0;
+	nextFrame = lastFrameStart = 0.0;
+	// Assume a coarse scheduler until we have measured the real one
+	sleepEstimate = sleepMean = 0.005;
+	sleepVariance = 0.0;
+	sleepCount = 1;
+	nFrameTimes = frameTimeIndex = 0;
+}
+
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	if(window != NULL)
+		timeEndPeriod(1);
+#endif
+}
+
+
+void FramePacer::init(GLFWwindow *window, PacingMode mode, double targetFramerate)
+{
+	this->window = window;
+	timePerFrame = 1.0 / targetFramerate;
+#ifdef _WIN32
+	// Default Windows timer resolution is ~15.6 ms, too coarse to sleep between frames
+	timeBeginPeriod(1);
+#endif
+	setMode(mode);
+	nextFrame = lastFrameStart = glfwGetTime();
+}
+
+void FramePacer::setMode(PacingMode mode)
+{
+	this->mode = mode;
+	glfwSwapInterval(mode == PACING_VSYNC ? 1 : 0);
+}
+
+void FramePacer::waitForNextFrame()
+{
+	PROFILE_SCOPE("FramePacer::waitForNextFrame");
+	double period = targetPeriod(), now;
+
+	if(period > 0.0)
+	{
+		if(glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+		{
+			// Nothing is visible, so block on the event queue instead of timing precisely
+			now = glfwGetTime();
+			while(now < nextFrame)
+			{
+				glfwWaitEventsTimeout(nextFrame - now);
+				now = glfwGetTime();
+			}
+		}
+		else
+			sleepUntil(nextFrame);
+
+		// Keep a regular cadence unless we are more than a whole frame late
+		now = glfwGetTime();
+		nextFrame += period;
+		if(nextFrame < now)
+			nextFrame = now + period;
+	}
+	else
+		nextFrame = glfwGetTime();
+
+	// Poll as late as possible so input is fresh for the update
+	glfwPollEvents();
+	measureFrame(glfwGetTime());
+}
+
+double FramePacer::averageFrameTime() const
+{
+	double sum = 0.0;
+
+	if(nFrameTimes == 0)
+		return 0.0;
+	for(int i=0; i<nFrameTimes; i++)
+		sum += frameTimes[i];
+
+	return sum / nFrameTimes;
+}
+
+double FramePacer::jitter() const
+{
+	double mean = averageFrameTime(), sum = 0.0;
+
+	if(nFrameTimes < 2)
+		return 0.0;
+	for(int i=0; i<nFrameTimes; i++)
+		sum += (frameTimes[i] - mean) * (frameTimes[i] - mean);
+
+	return sqrt(sum / (nFrameTimes - 1));
+}
+
+double FramePacer::maxDeviation() const
+{
+	double mean = averageFrameTime(), maxDev = 0.0;
+
+	for(int i=0; i<nFrameTimes; i++)
+		maxDev = fmax(maxDev, fabs(frameTimes[i] - mean));
+
+	return maxDev;
+}
+
+double FramePacer::targetPeriod() const
+{
+	if(glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+		return 1.0 / ICONIFIED_FRAMERATE;
+	if(!glfwGetWindowAttrib(window, GLFW_FOCUSED))
+		return fmax(mode == PACING_CAPPED ? timePerFrame : 0.0, 1.0 / UNFOCUSED_FRAMERATE);
+	if(mode == PACING_CAPPED)
+		return timePerFrame;
+
+	// With vsync the buffer swap does the waiting, uncapped never waits
+	return 0.0;
+}
+
+// Sleeps in 1 ms steps while the remaining time is clearly longer than
+// a sleep usually takes, then spins for the rest. How long a sleep
+// takes is learned from the previous ones (mean + standard deviation).
+
+void FramePacer::sleepUntil(double deadline)
+{
+	double now = glfwGetTime(), start, observed, delta;
+
+	while(deadline - now > sleepEstimate)
+	{
+		start = now;
+		this_thread::sleep_for(chrono::milliseconds(1));
+		now = glfwGetTime();
+
+		observed = now - start;
+		if(sleepCount < MAX_SLEEP_SAMPLES)
+			sleepCount++;
+		delta = observed - sleepMean;
+		sleepMean += delta / sleepCount;
+		sleepVariance = (1.0 - 1.0 / sleepCount) * (sleepVariance + delta * delta / sleepCount);
+		sleepEstimate = sleepMean + sqrt(sleepVariance);
+	}
+	spinUntil(deadline);
+}
+
+void FramePacer::spinUntil(double deadline)
+{
+	while(glfwGetTime() < deadline)
+		this_thread::yield();
+}
+
+void FramePacer::measureFrame(double frameStart)
+{
+	frameTimes[frameTimeIndex] = frameStart - lastFrameStart;
+	frameTimeIndex = (frameTimeIndex + 1) % FRAME_STATS_SIZE;
+	if(nFrameTimes < FRAME_STATS_SIZE)
+		nFrameTimes++;
+	lastFrameStart = frameStart;
+}
+
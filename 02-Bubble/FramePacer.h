@@ -0,0 +1,60 @@
+#ifndef _FRAME_PACER_INCLUDE
+#define _FRAME_PACER_INCLUDE
+
+
+#include <GLFW/glfw3.h>
+
+
+#define FRAME_STATS_SIZE 120 // Number of frames used to measure jitter
+
+
+enum PacingMode { PACING_VSYNC, PACING_UNCAPPED, PACING_CAPPED };
+
+
+// FramePacer decides when the next frame of the game loop may start.
+// Instead of spinning on glfwGetTime it sleeps for most of the wait and
+// only spins the last fraction of a millisecond, so the CPU stays idle
+// between frames without missing deadlines. When the window loses focus
+// or is iconified the framerate is throttled. It also measures how
+// regular the resulting frame times are.
+
+
+class FramePacer
+{
+
+public:
+	FramePacer();
+	~FramePacer();
+
+	// These methods should be called with an active OpenGL context
+	void init(GLFWwindow *window, PacingMode mode, double targetFramerate);
+	void setMode(PacingMode mode);
+	PacingMode getMode() const { return mode; }
+
+	// Waits until the next frame is due and polls window events
+	void waitForNextFrame();
+
+	// Frame time statistics over the last FRAME_STATS_SIZE frames (in seconds)
+	double averageFrameTime() const;
+	double jitter() const;
+	double maxDeviation() const;
+
+private:
+	double targetPeriod() const;
+	void sleepUntil(double deadline);
+	void spinUntil(double deadline);
+	void measureFrame(double frameStart);
+
+private:
+	GLFWwindow *window;
+	PacingMode mode;
+	double timePerFrame, nextFrame, lastFrameStart;
+	double sleepEstimate, sleepMean, sleepVariance; // Running estimate of how long a 1 ms sleep really takes
+	long long sleepCount;
+	double frameTimes[FRAME_STATS_SIZE];
+	int nFrameTimes, frameTimeIndex;
+
+};
+
+
+#endif // _FRAME_PACER_INCLUDE
@@ -0,0 +1,92 @@
+#include <cstring>
+#include "FrameUniforms.h"
+
+
+#define FENCE_TIMEOUT 1000000000 // One second, in nanoseconds
+
+
+FrameUniforms::FrameUniforms()
+{
+	buffer = 0;
+	bPersistent = false;
+	regionSize = 0;
+	region = -1;
+	mapped = NULL;
+	for(int i=0; i<FRAME_UNIFORM_REGIONS; i++)
+		fences[i] = 0;
+}
+
+
+void FrameUniforms::init()
+{
+	GLint alignment;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	bPersistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+	if(bPersistent)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		// Each region must start at a multiple of the uniform buffer alignment
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		regionSize = ((sizeof(FrameData) + alignment - 1) / alignment) * alignment;
+		glBufferStorage(GL_UNIFORM_BUFFER, FRAME_UNIFORM_REGIONS * regionSize, NULL, flags);
+		mapped = (unsigned char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, FRAME_UNIFORM_REGIONS * regionSize, flags);
+		bPersistent = (mapped != NULL);
+	}
+	if(!bPersistent)
+	{
+		regionSize = sizeof(FrameData);
+		glBufferData(GL_UNIFORM_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniforms::free()
+{
+	for(int i=0; i<FRAME_UNIFORM_REGIONS; i++)
+	{
+		if(fences[i] != 0)
+			glDeleteSync(fences[i]);
+		fences[i] = 0;
+	}
+	if(mapped != NULL)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		mapped = NULL;
+	}
+	glDeleteBuffers(1, &buffer);
+	buffer = 0;
+}
+
+void FrameUniforms::update(const FrameData &data)
+{
+	if(bPersistent)
+	{
+		// Everything drawn since the last update read the previous region
+		if(region >= 0)
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region + 1) % FRAME_UNIFORM_REGIONS;
+		// The GPU finished with this region frames ago, so this rarely waits
+		if(fences[region] != 0)
+		{
+			glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+			glDeleteSync(fences[region]);
+			fences[region] = 0;
+		}
+		memcpy(mapped + region * regionSize, &data, sizeof(FrameData));
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, buffer, region * regionSize, sizeof(FrameData));
+	}
+	else
+	{
+		// Orphaning gives the driver fresh storage instead of waiting for the old one
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, buffer);
+	}
+}
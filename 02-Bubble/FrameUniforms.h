@@ -0,0 +1,55 @@
+#ifndef _FRAME_UNIFORMS_INCLUDE
+#define _FRAME_UNIFORMS_INCLUDE
+
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "ShaderProgram.h"
+
+
+#define FRAME_UNIFORM_REGIONS 3 // Frames that may be in flight with the persistent buffer
+
+
+// Mirrors the std140 layout of the FrameData block declared in the shaders
+
+struct FrameData
+{
+	glm::mat4 projection;  // offset 0
+	glm::vec2 screenSize;  // offset 64
+	float time;            // offset 72, in seconds
+	float padding;
+};
+
+
+// FrameUniforms holds the uniforms that are the same for every draw of a
+// frame in one buffer bound to FRAME_DATA_BINDING. Programs bind their
+// FrameData block to that point when linked, so each frame uploads the
+// data once no matter how many programs use it.
+// With ARB_buffer_storage the buffer is persistently mapped and split in
+// regions fenced per frame; otherwise it is orphaned on every update.
+
+
+class FrameUniforms
+{
+
+public:
+	FrameUniforms();
+
+	// These methods should be called with an active OpenGL context
+	void init();
+	void free();
+
+	void update(const FrameData &data);
+
+private:
+	GLuint buffer;
+	bool bPersistent;
+	GLint regionSize;
+	int region;
+	unsigned char *mapped;
+	GLsync fences[FRAME_UNIFORM_REGIONS];
+
+};
+
+
+#endif // _FRAME_UNIFORMS_INCLUDE
@@ -0,0 +1,101 @@
+#include "GLState.h"
+
+
+// Binding 0 is used both for "nothing bound" and "unknown", so invalidate
+// uses an id no object will ever have
+
+#define UNKNOWN_BINDING 0xFFFFFFFF
+
+
+GLState::GLState()
+{
+	invalidate();
+}
+
+
+void GLState::useProgram(GLuint program)
+{
+	if(this->program != program)
+	{
+		glUseProgram(program);
+		this->program = program;
+	}
+}
+
+void GLState::bindVertexArray(GLuint vao)
+{
+	if(this->vao != vao)
+	{
+		glBindVertexArray(vao);
+		this->vao = vao;
+	}
+}
+
+void GLState::bindTexture(int unit, GLuint texture)
+{
+	if(textures[unit] != texture)
+	{
+		activeTexture(unit);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		textures[unit] = texture;
+	}
+}
+
+void GLState::bindTextureForUpdate(int unit, GLuint texture)
+{
+	activeTexture(unit);
+	bindTexture(unit, texture);
+}
+
+void GLState::bindSampler(int unit, GLuint sampler)
+{
+	if(samplers[unit] != sampler)
+	{
+		glBindSampler(unit, sampler);
+		samplers[unit] = sampler;
+	}
+}
+
+GLuint GLState::sampler(GLint wrapS, GLint wrapT, GLint minFilter, GLint magFilter)
+{
+	SamplerDesc desc;
+
+	if(!GLEW_VERSION_3_3 && !GLEW_ARB_sampler_objects)
+		return 0;
+	for(unsigned int i=0; i<samplerObjects.size(); i++)
+	{
+		const SamplerDesc &other = samplerObjects[i];
+
+		if(other.wrapS == wrapS && other.wrapT == wrapT && other.minFilter == minFilter && other.magFilter == magFilter)
+			return other.id;
+	}
+	desc.wrapS = wrapS;
+	desc.wrapT = wrapT;
+	desc.minFilter = minFilter;
+	desc.magFilter = magFilter;
+	glGenSamplers(1, &desc.id);
+	glSamplerParameteri(desc.id, GL_TEXTURE_WRAP_S, wrapS);
+	glSamplerParameteri(desc.id, GL_TEXTURE_WRAP_T, wrapT);
+	glSamplerParameteri(desc.id, GL_TEXTURE_MIN_FILTER, minFilter);
+	glSamplerParameteri(desc.id, GL_TEXTURE_MAG_FILTER, magFilter);
+	samplerObjects.push_back(desc);
+
+	return desc.id;
+}
+
+void GLState::invalidate()
+{
+	program = vao = UNKNOWN_BINDING;
+	for(int i=0; i<GL_STATE_TEXTURE_UNITS; i++)
+		textures[i] = samplers[i] = UNKNOWN_BINDING;
+	activeUnit = -1;
+}
+
+void GLState::activeTexture(int unit)
+{
+	if(activeUnit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		activeUnit = unit;
+	}
+}
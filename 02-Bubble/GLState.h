@@ -0,0 +1,71 @@
+#ifndef _GL_STATE_INCLUDE
+#define _GL_STATE_INCLUDE
+
+
+#include <vector>
+#include <GL/glew.h>
+
+
+#define GL_STATE_TEXTURE_UNITS 8
+
+
+using namespace std;
+
+
+// GLState remembers what is bound to the context (program, vertex array,
+// textures and samplers) and only calls OpenGL when a binding really changes.
+// Everything that binds one of these must go through it, or the cache will
+// be out of date. It also owns the sampler objects, one per combination of
+// wrap and filter modes, so textures never have to set their parameters.
+
+
+class GLState
+{
+
+private:
+	GLState();
+
+public:
+	static GLState &instance()
+	{
+		static GLState S;
+
+		return S;
+	}
+
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	// Enough to draw with the texture, but the active unit is left wherever
+	// it was if the texture was already bound
+	void bindTexture(int unit, GLuint texture);
+	// Also makes unit the active one, so the texture calls that follow
+	// (glTexSubImage2D, glTexParameteri...) change this texture
+	void bindTextureForUpdate(int unit, GLuint texture);
+	void bindSampler(int unit, GLuint sampler);
+
+	// Returns a sampler object with these parameters, created the first time
+	// it is asked for. Returns 0 if sampler objects are not supported.
+	GLuint sampler(GLint wrapS, GLint wrapT, GLint minFilter, GLint magFilter);
+
+	// Forget every binding, e.g. after deleting an object that may be bound
+	void invalidate();
+
+private:
+	struct SamplerDesc
+	{
+		GLint wrapS, wrapT, minFilter, magFilter;
+		GLuint id;
+	};
+
+	void activeTexture(int unit);
+
+private:
+	GLuint program, vao;
+	GLuint textures[GL_STATE_TEXTURE_UNITS], samplers[GL_STATE_TEXTURE_UNITS];
+	int activeUnit;
+	vector<SamplerDesc> samplerObjects;
+
+};
+
+
+#endif // _GL_STATE_INCLUDE
@@ -1,38 +1,118 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Game.h"
+#include "AssetCache.h"
+#include "Profiler.h"
 
 
-void Game::init()
+void Game::init(bool headless)
 {
+	PROFILE_SCOPE("Game::init");
 	bPlay = true;
-	glClearColor(0.282f, 0.804f, 0.871f, 1.0f);
+	bHeadless = headless;
+	input = InputState();
+	windowSize = glm::ivec2(SCREEN_WIDTH, SCREEN_HEIGHT);
+	if(!bHeadless)
+		screen.init(SCREEN_WIDTH, SCREEN_HEIGHT);
 	scene.init();
+	publishSnapshot(0.0);
 }
 
-bool Game::update(int deltaTime)
+bool Game::update(float deltaTime)
 {
+	PROFILE_SCOPE("Game::update");
+	InputEvent event;
+
+	// Latch the input as late as possible: drain every event received up to
+	// now. While replaying, the recording supplies the events instead and
+	// live ones are discarded.
+	input.beginTick();
+	tickEvents.clear();
+	if(replayer.isPlaying())
+	{
+		while(inputQueue.pop(event));
+		if(!replayer.replayInput(tickEvents))
+		{
+			// End of the recording: release everything so live input starts clean
+			input.releaseAll();
+			if(bHeadless)
+				bPlay = false;
+		}
+	}
+	else
+	{
+		while(inputQueue.pop(event))
+			tickEvents.push_back(event);
+	}
+	for(unsigned int i=0; i<tickEvents.size(); i++)
+		input.apply(tickEvents[i]);
+	recorder.recordInput(tickEvents);
+
 	scene.update(deltaTime);
 
+	if(recorder.isRecording() || replayer.isPlaying())
+	{
+		unsigned int stateHash = scene.stateHash();
+
+		recorder.recordState(stateHash);
+		replayer.checkState(stateHash);
+	}
+
 	return bPlay;
 }
 
-void Game::render()
+void Game::publishSnapshot(double time)
+{
+	PROFILE_SCOPE("Game::publishSnapshot");
+	SceneSnapshot &snapshot = snapshots.writeBuffer();
+
+	scene.snapshot(snapshot);
+	snapshot.time = time;
+	snapshots.publish();
+}
+
+void Game::render(double time)
 {
+	PROFILE_SCOPE("Game::render");
+	float alpha = 1.f;
+
+	snapshots.update();
+	const SceneSnapshot &snapshot = snapshots.readBuffer();
+	// Fraction of the next tick that has elapsed since the snapshot was exact
+	if(snapshot.deltaTime > 0.f)
+		alpha = glm::clamp(float(1000.0 * (time - snapshot.time) / snapshot.deltaTime), 0.f, 1.f);
+	// Finish the assets loaded in the background, a bit every frame
+	AssetCache::instance().update();
+	// The scene is drawn at its native resolution and scaled up to the
+	// window in one blit
+	screen.bind(windowSize);
+	glClearColor(0.282f, 0.804f, 0.871f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	scene.render();
+	scene.render(snapshot, alpha);
+	screen.present(windowSize);
+}
+
+void Game::resize(int width, int height)
+{
+	windowSize = glm::ivec2(width, height);
 }
 
 void Game::keyPressed(int key)
 {
+	InputEvent event = { glfwGetTime(), key, true };
+
 	if(key == GLFW_KEY_ESCAPE) // Escape code
 		bPlay = false;
-	keys[key] = true;
+	if(InputState::validKey(key))
+		inputQueue.push(event);
 }
 
 void Game::keyReleased(int key)
 {
-	keys[key] = false;
+	InputEvent event = { glfwGetTime(), key, false };
+
+	if(InputState::validKey(key))
+		inputQueue.push(event);
 }
 
 void Game::mouseMove(int x, int y)
@@ -49,7 +129,28 @@ void Game::mouseRelease(int button)
 
 bool Game::getKey(int key) const
 {
-	return keys[key];
+	return input.isDown(key);
+}
+
+bool Game::getKeyPressed(int key) const
+{
+	return input.wasPressed(key);
+}
+
+bool Game::getKeyReleased(int key) const
+{
+	return input.wasReleased(key);
+}
+
+bool Game::startRecording(const string &filename)
+{
+	return recorder.start(filename);
+}
+
+bool Game::startReplay(const string &filename)
+{
+	input = InputState();
+	return replayer.start(filename);
 }
 
 
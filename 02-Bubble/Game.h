@@ -2,15 +2,23 @@
 #define _GAME_INCLUDE
 
 
+#include <atomic>
 #include <GLFW/glfw3.h>
 #include "Scene.h"
+#include "InputQueue.h"
+#include "InputState.h"
+#include "InputReplay.h"
+#include "TripleBuffer.h"
+#include "RenderTarget.h"
 
 
 #define SCREEN_WIDTH 256
 #define SCREEN_HEIGHT 240
 
 
-// Game is a singleton (a class with a single instance) that represents our whole application
+// Game is a singleton (a class with a single instance) that represents our whole application.
+// Updates may run on a simulation thread while rendering and input callbacks run on the
+// main thread: the two sides only share a queue of input events and a mailbox of scene snapshots.
 
 
 class Game
@@ -27,9 +35,15 @@ public:
 		return G;
 	}
 	
-	void init();
-	bool update(int deltaTime);
-	void render();
+	// In headless mode no OpenGL context exists: only the simulation runs
+	void init(bool headless = false);
+	bool update(float deltaTime);
+	// Makes the state of the last update available to render, time is when that state is exact
+	void publishSnapshot(double time);
+	// Draws the latest published snapshot, interpolated for the given time
+	void render(double time);
+	// Size of the window framebuffer, in pixels
+	void resize(int width, int height);
 	
 	// Input callback methods
 	void keyPressed(int key);
@@ -38,13 +52,33 @@ public:
 	void mousePress(int button);
 	void mouseRelease(int button);
 
+	// Key state of the current tick, see InputState
 	bool getKey(int key) const;
+	bool getKeyPressed(int key) const;
+	bool getKeyReleased(int key) const;
+	bool isHeadless() const { return bHeadless; }
+	const GpuTimer &getGpuTimer() const { return scene.getGpuTimer(); }
+	// Only used by the render thread, like the rest of the drawing state
+	void setTileRenderMode(TileRenderMode mode) { scene.setTileRenderMode(mode); }
+	TileRenderMode getTileRenderMode() const { return scene.getTileRenderMode(); }
+
+	// Input recording and replay, see InputReplay.h
+	bool startRecording(const string &filename);
+	bool startReplay(const string &filename);
 
 private:
-	bool bPlay; // Continue to play game?
-	bool keys[GLFW_KEY_LAST+1]; // Store key states so that 
-							    // we can have access at any time
+	std::atomic<bool> bPlay; // Continue to play game?
+	bool bHeadless;
+	InputQueue inputQueue; // Filled by the input callbacks
+	InputState input; // Latched from the queue at the start of each tick so that 
+					  // we can have access at any time during the update
+	vector<InputEvent> tickEvents;
 	Scene scene;
+	RenderTarget screen; // The scene at SCREEN_WIDTH x SCREEN_HEIGHT
+	glm::ivec2 windowSize;
+	TripleBuffer<SceneSnapshot> snapshots;
+	InputRecorder recorder;
+	InputReplayer replayer;
 
 };
 
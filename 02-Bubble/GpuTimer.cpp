@@ -0,0 +1,197 @@
+#include <iostream>
+#include <cstring>
+#include "GpuTimer.h"
+
+
+#define CALIBRATION_INTERVAL 60 // Frames between GPU/CPU clock resynchronizations
+#define AVERAGE_WEIGHT 0.05     // Weight of the newest frame in the running averages
+
+
+using namespace std;
+
+
+GpuTimer::GpuTimer()
+{
+	bSupported = bInFrame = false;
+	currentFrame = nFrames = nDropped = 0;
+	nOpenPasses = nPassNames = 0;
+	frameAverage = 0.0;
+	gpuToCpuOffset = 0;
+	track = NULL;
+	for(int i=0; i<GPU_TIMER_FRAMES; i++)
+	{
+		frames[i].nPasses = 0;
+		frames[i].pending = false;
+	}
+}
+
+GpuTimer::~GpuTimer()
+{
+}
+
+
+void GpuTimer::init()
+{
+	GLint bits = 0;
+
+	// Timer queries are core since OpenGL 3.3 and exposed by Mesa (llvmpipe included),
+	// but a driver may still report a counter without any bits
+	bSupported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	if(bSupported)
+	{
+		glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+		bSupported = bits > 0;
+	}
+	if(!bSupported)
+	{
+		cout << "GL timer queries not available, GPU timings disabled" << endl;
+		return;
+	}
+	for(int i=0; i<GPU_TIMER_FRAMES; i++)
+	{
+		glGenQueries(2 * GPU_TIMER_MAX_PASSES, frames[i].queries);
+		frames[i].nPasses = 0;
+		frames[i].pending = false;
+	}
+	calibrate();
+#ifdef PROFILER_ENABLED
+	if(track == NULL)
+		track = Profiler::instance().createTrack("GPU");
+#endif
+}
+
+void GpuTimer::free()
+{
+	if(!bSupported)
+		return;
+	for(int i=0; i<GPU_TIMER_FRAMES; i++)
+		glDeleteQueries(2 * GPU_TIMER_MAX_PASSES, frames[i].queries);
+	bSupported = false;
+}
+
+void GpuTimer::beginFrame()
+{
+	if(!bSupported)
+		return;
+	FrameQueries &frame = frames[currentFrame];
+
+	// This slot was last used GPU_TIMER_FRAMES - 1 frames ago. Its results are
+	// normally ready by now; if not, they are dropped rather than waited for.
+	if(frame.pending)
+	{
+		GLint available = 0;
+
+		glGetQueryObjectiv(frame.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available)
+			readBack(frame);
+		else
+			nDropped++;
+	}
+	if(nFrames % CALIBRATION_INTERVAL == 0)
+		calibrate();
+	frame.nPasses = 0;
+	frame.pending = false;
+	nOpenPasses = 0;
+	bInFrame = true;
+}
+
+void GpuTimer::endFrame()
+{
+	if(!bSupported || !bInFrame)
+		return;
+	while(nOpenPasses > 0)
+		endPass();
+	frames[currentFrame].pending = frames[currentFrame].nPasses > 0;
+	currentFrame = (currentFrame + 1) % GPU_TIMER_FRAMES;
+	nFrames++;
+	bInFrame = false;
+}
+
+void GpuTimer::beginPass(const char *name)
+{
+	if(!bSupported || !bInFrame || nOpenPasses == GPU_TIMER_MAX_PASSES)
+		return;
+	FrameQueries &frame = frames[currentFrame];
+
+	// Passes beyond the pool size are not timed, but still balanced by endPass
+	if(frame.nPasses == GPU_TIMER_MAX_PASSES)
+	{
+		openPasses[nOpenPasses++] = -1;
+		return;
+	}
+	glQueryCounter(frame.queries[2 * frame.nPasses], GL_TIMESTAMP);
+	frame.names[frame.nPasses] = name;
+	openPasses[nOpenPasses++] = frame.nPasses++;
+}
+
+void GpuTimer::endPass()
+{
+	if(!bSupported || !bInFrame || nOpenPasses == 0)
+		return;
+	FrameQueries &frame = frames[currentFrame];
+	int pass = openPasses[--nOpenPasses];
+
+	if(pass < 0)
+		return;
+	glQueryCounter(frame.queries[2 * pass + 1], GL_TIMESTAMP);
+	frame.lastQuery = frame.queries[2 * pass + 1];
+}
+
+double GpuTimer::passTime(const char *name) const
+{
+	for(int i=0; i<nPassNames; i++)
+		if(strcmp(passNames[i], name) == 0)
+			return passAverages[i];
+
+	return 0.0;
+}
+
+void GpuTimer::readBack(FrameQueries &frame)
+{
+	GLuint64 start, end, frameStart = 0, frameEnd = 0;
+	double ms;
+	int index;
+
+	for(int pass=0; pass<frame.nPasses; pass++)
+	{
+		glGetQueryObjectui64v(frame.queries[2 * pass], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(frame.queries[2 * pass + 1], GL_QUERY_RESULT, &end);
+		if(pass == 0 || start < frameStart)
+			frameStart = start;
+		if(pass == 0 || end > frameEnd)
+			frameEnd = end;
+		ms = (end - start) / 1e6;
+
+		for(index=0; index<nPassNames; index++)
+			if(strcmp(passNames[index], frame.names[pass]) == 0)
+				break;
+		if(index == nPassNames)
+		{
+			if(nPassNames == GPU_TIMER_MAX_PASSES)
+				continue;
+			passNames[nPassNames] = frame.names[pass];
+			passAverages[nPassNames++] = ms;
+		}
+		else
+			passAverages[index] += AVERAGE_WEIGHT * (ms - passAverages[index]);
+#ifdef PROFILER_ENABLED
+		Profiler::instance().record(track, frame.names[pass], (long long)start + gpuToCpuOffset, (long long)end + gpuToCpuOffset);
+#endif
+	}
+	ms = (frameEnd - frameStart) / 1e6;
+	if(frameAverage == 0.0)
+		frameAverage = ms;
+	else
+		frameAverage += AVERAGE_WEIGHT * (ms - frameAverage);
+}
+
+// GPU timestamps use their own clock. Sampling both clocks together gives the
+// offset that places GPU passes on the same timeline as the CPU zones.
+
+void GpuTimer::calibrate()
+{
+	GLint64 gpuNow = 0;
+
+	glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+	gpuToCpuOffset = Profiler::instance().now() - gpuNow;
+}
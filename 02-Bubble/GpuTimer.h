@@ -0,0 +1,97 @@
+#ifndef _GPU_TIMER_INCLUDE
+#define _GPU_TIMER_INCLUDE
+
+
+#include <GL/glew.h>
+#include "Profiler.h"
+
+
+#define GPU_TIMER_FRAMES 4      // Frames in flight, results are read this many frames late
+#define GPU_TIMER_MAX_PASSES 16 // Passes timed per frame
+
+
+// GpuTimer measures how long the GPU spends on each pass of a frame.
+// Every pass is bracketed by two GL_TIMESTAMP queries (they nest, unlike
+// GL_TIME_ELAPSED). Queries are pooled per frame and only read back once
+// their results are available, so the CPU never waits for the GPU; if a
+// frame is still pending when its slot comes around again, it is dropped.
+// Finished passes go to the profiler on a "GPU" track aligned with the CPU
+// zones, and a running average per pass is kept for on-screen stats.
+
+
+class GpuTimer
+{
+
+public:
+	GpuTimer();
+	~GpuTimer();
+
+	// These methods should be called with an active OpenGL context
+	void init();
+	void free();
+	bool isSupported() const { return bSupported; }
+
+	void beginFrame();
+	void endFrame();
+
+	// Name must be a string literal
+	void beginPass(const char *name);
+	void endPass();
+
+	// Averages (in milliseconds) over the recent frames
+	double frameTime() const { return frameAverage; }
+	double passTime(const char *name) const;
+
+	int droppedFrames() const { return nDropped; }
+
+private:
+	struct FrameQueries
+	{
+		GLuint queries[2 * GPU_TIMER_MAX_PASSES];
+		const char *names[GPU_TIMER_MAX_PASSES];
+		GLuint lastQuery; // Results become available in submission order
+		int nPasses;
+		bool pending;
+	};
+
+	void readBack(FrameQueries &frame);
+	void calibrate();
+
+private:
+	bool bSupported, bInFrame;
+	FrameQueries frames[GPU_TIMER_FRAMES];
+	int currentFrame, nFrames, nDropped;
+	int openPasses[GPU_TIMER_MAX_PASSES], nOpenPasses;
+	const char *passNames[GPU_TIMER_MAX_PASSES];
+	double passAverages[GPU_TIMER_MAX_PASSES], frameAverage;
+	int nPassNames;
+	long long gpuToCpuOffset; // Nanoseconds to add to GPU timestamps to get profiler time
+	ProfileRing *track;
+
+};
+
+
+// GpuScope times the GPU work submitted in the block it lives in,
+// and the CPU time spent submitting it under the same name
+
+class GpuScope
+{
+
+public:
+#ifdef PROFILER_ENABLED
+	GpuScope(GpuTimer &timer, const char *name) : timer(timer), cpuScope(name) { timer.beginPass(name); }
+#else
+	GpuScope(GpuTimer &timer, const char *name) : timer(timer) { timer.beginPass(name); }
+#endif
+	~GpuScope() { timer.endPass(); }
+
+private:
+	GpuTimer &timer;
+#ifdef PROFILER_ENABLED
+	ProfileScope cpuScope;
+#endif
+
+};
+
+
+#endif // _GPU_TIMER_INCLUDE
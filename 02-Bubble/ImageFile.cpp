@@ -0,0 +1,213 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <SOIL.h>
+#include "ImageFile.h"
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+#define BAKED_MAGIC "BTEX"
+#define BAKED_VERSION 1
+
+
+struct BakedHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t format;      // PixelFormat of the rows
+	uint32_t dataOffset;  // From the start of the file
+};
+
+
+ImageFile::ImageFile()
+{
+	data = NULL;
+	imageSize = glm::ivec2(0);
+	decoded = NULL;
+	mapping = NULL;
+	mappingSize = 0;
+#ifdef _WIN32
+	file = fileMapping = NULL;
+#endif
+}
+
+ImageFile::~ImageFile()
+{
+	close();
+}
+
+
+bool ImageFile::load(const string &filename, PixelFormat format)
+{
+	PROFILE_SCOPE("ImageFile::load");
+
+	close();
+	if(map(bakedName(filename), format))
+	{
+		struct stat imageStat, bakedStat;
+
+		// A baked file older than its image is out of date
+		if(stat(filename.c_str(), &imageStat) != 0 || stat(bakedName(filename).c_str(), &bakedStat) != 0 || bakedStat.st_mtime >= imageStat.st_mtime)
+			return true;
+		cout << bakedName(filename) << " is older than " << filename << ", bake it again" << endl;
+		close();
+	}
+	decoded = SOIL_load_image(filename.c_str(), &imageSize.x, &imageSize.y, 0, format == TEXTURE_PIXEL_FORMAT_RGB ? SOIL_LOAD_RGB : SOIL_LOAD_RGBA);
+	data = decoded;
+
+	return decoded != NULL;
+}
+
+void ImageFile::close()
+{
+	if(decoded != NULL)
+		SOIL_free_image_data(decoded);
+	decoded = NULL;
+#ifdef _WIN32
+	if(mapping != NULL)
+		UnmapViewOfFile(mapping);
+	if(fileMapping != NULL)
+		CloseHandle(fileMapping);
+	if(file != NULL)
+		CloseHandle(file);
+	file = fileMapping = NULL;
+#else
+	if(mapping != NULL)
+		munmap(mapping, mappingSize);
+#endif
+	mapping = NULL;
+	mappingSize = 0;
+	data = NULL;
+	imageSize = glm::ivec2(0);
+}
+
+bool ImageFile::bake(const string &filename, PixelFormat format)
+{
+	ImageFile image;
+	BakedHeader header;
+	char padding[IMAGE_FILE_ALIGNMENT] = { 0 };
+	int channels = format == TEXTURE_PIXEL_FORMAT_RGB ? 3 : 4;
+
+	// Always decode, the baked file may be the stale one
+	image.decoded = SOIL_load_image(filename.c_str(), &image.imageSize.x, &image.imageSize.y, 0, channels == 3 ? SOIL_LOAD_RGB : SOIL_LOAD_RGBA);
+	if(image.decoded == NULL)
+	{
+		cout << "Cannot load " << filename << endl;
+		return false;
+	}
+
+	ofstream fout(bakedName(filename).c_str(), ios::binary);
+	if(!fout.is_open())
+	{
+		cout << "Cannot create " << bakedName(filename) << endl;
+		return false;
+	}
+	memcpy(header.magic, BAKED_MAGIC, 4);
+	header.version = BAKED_VERSION;
+	header.width = image.imageSize.x;
+	header.height = image.imageSize.y;
+	header.format = format;
+	header.dataOffset = IMAGE_FILE_ALIGNMENT;
+	fout.write((const char *)&header, sizeof(header));
+	fout.write(padding, IMAGE_FILE_ALIGNMENT - sizeof(header));
+	fout.write((const char *)image.decoded, streamsize(channels) * image.imageSize.x * image.imageSize.y);
+
+	return bool(fout);
+}
+
+string ImageFile::bakedName(const string &filename)
+{
+	size_t dot = filename.find_last_of('.');
+
+	if(dot == string::npos || filename.find_first_of("/\\", dot) != string::npos)
+		return filename + IMAGE_FILE_BAKED_EXTENSION;
+	return filename.substr(0, dot) + IMAGE_FILE_BAKED_EXTENSION;
+}
+
+// The mapping is read only and private. The pages are read ahead as soon
+// as it exists and the first reader (glTexImage2D) waits only for the I/O.
+
+bool ImageFile::map(const string &filename, PixelFormat format)
+{
+	const BakedHeader *header;
+	int channels = format == TEXTURE_PIXEL_FORMAT_RGB ? 3 : 4;
+
+#ifdef _WIN32
+	LARGE_INTEGER fileSize;
+
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		file = NULL;
+		return false;
+	}
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < LONGLONG(sizeof(BakedHeader)))
+	{
+		close();
+		return false;
+	}
+	mappingSize = size_t(fileSize.QuadPart);
+	fileMapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(fileMapping != NULL)
+		mapping = MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	struct stat fileStat;
+	int fd = open(filename.c_str(), O_RDONLY);
+
+	if(fd < 0)
+		return false;
+	if(fstat(fd, &fileStat) == 0 && size_t(fileStat.st_size) >= sizeof(BakedHeader))
+	{
+		mappingSize = size_t(fileStat.st_size);
+		mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapping == MAP_FAILED)
+			mapping = NULL;
+		else
+			madvise(mapping, mappingSize, MADV_WILLNEED);
+	}
+	// The mapping keeps the file alive
+	::close(fd);
+#endif
+	if(mapping == NULL)
+	{
+		close();
+		return false;
+	}
+
+	header = (const BakedHeader *)mapping;
+	if(memcmp(header->magic, BAKED_MAGIC, 4) != 0 || header->version != BAKED_VERSION)
+	{
+		cout << filename << " is not a baked image" << endl;
+		close();
+		return false;
+	}
+	// Baked for a different format, decode the image instead
+	if(header->format != uint32_t(format))
+	{
+		close();
+		return false;
+	}
+	if(header->dataOffset % IMAGE_FILE_ALIGNMENT != 0 || header->dataOffset + size_t(channels) * header->width * header->height > mappingSize)
+	{
+		cout << filename << " is truncated" << endl;
+		close();
+		return false;
+	}
+	imageSize = glm::ivec2(header->width, header->height);
+	data = (const unsigned char *)mapping + header->dataOffset;
+
+	return true;
+}
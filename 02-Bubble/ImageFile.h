@@ -0,0 +1,63 @@
+#ifndef _IMAGE_FILE_INCLUDE
+#define _IMAGE_FILE_INCLUDE
+
+
+#include <string>
+#include <glm/glm.hpp>
+#include "Texture.h"
+
+
+#define IMAGE_FILE_BAKED_EXTENSION ".tex"
+#define IMAGE_FILE_ALIGNMENT 64 // The pixels of a baked file start at a multiple of this
+
+
+using namespace std;
+
+
+// ImageFile gives the pixels of an image ready for glTexImage2D. If the
+// image has been baked (see bake()) the baked file is mapped into memory
+// and the pixels are read straight from the mapping, otherwise the PNG
+// is decoded. A baked file is a header followed by the rows, tightly
+// packed and in the pixel format the game loads the image with.
+// ImageFile does not need OpenGL, so it can be used by the loader threads.
+
+
+class ImageFile
+{
+
+public:
+	ImageFile();
+	~ImageFile();
+
+	bool load(const string &filename, PixelFormat format);
+	void close();
+
+	const unsigned char *pixels() const { return data; }
+	const glm::ivec2 &size() const { return imageSize; }
+	bool isMapped() const { return mapping != NULL; }
+
+	// Writes the baked version of filename, next to it
+	static bool bake(const string &filename, PixelFormat format);
+	// images/bub.png is baked to images/bub.tex
+	static string bakedName(const string &filename);
+
+private:
+	ImageFile(const ImageFile &);
+	ImageFile &operator=(const ImageFile &);
+
+	bool map(const string &filename, PixelFormat format);
+
+private:
+	const unsigned char *data;
+	glm::ivec2 imageSize;
+	unsigned char *decoded;    // SOIL owns it
+	void *mapping;
+	size_t mappingSize;
+#ifdef _WIN32
+	void *file, *fileMapping;
+#endif
+
+};
+
+
+#endif // _IMAGE_FILE_INCLUDE
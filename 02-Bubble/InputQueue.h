@@ -0,0 +1,64 @@
+#ifndef _INPUT_QUEUE_INCLUDE
+#define _INPUT_QUEUE_INCLUDE
+
+
+#include <atomic>
+
+
+#define INPUT_QUEUE_SIZE 256 // Must be a power of two
+
+
+// A key press or release, stamped with the time (glfwGetTime) it was received
+
+struct InputEvent
+{
+	double time;
+	int key;
+	bool pressed;
+};
+
+
+// InputQueue carries input events from the thread running the GLFW callbacks
+// to the thread running the simulation. It is a single producer, single
+// consumer ring: push and pop never lock and never wait. If the consumer
+// stops draining, new events are dropped once the ring is full.
+
+
+class InputQueue
+{
+
+public:
+	InputQueue() : head(0), tail(0) {}
+
+	// Producer side. Returns false if the queue is full.
+	bool push(const InputEvent &event)
+	{
+		unsigned int t = tail.load(std::memory_order_relaxed);
+
+		if(t - head.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE)
+			return false;
+		events[t & (INPUT_QUEUE_SIZE - 1)] = event;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Returns false if the queue is empty.
+	bool pop(InputEvent &event)
+	{
+		unsigned int h = head.load(std::memory_order_relaxed);
+
+		if(h == tail.load(std::memory_order_acquire))
+			return false;
+		event = events[h & (INPUT_QUEUE_SIZE - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	InputEvent events[INPUT_QUEUE_SIZE];
+	std::atomic<unsigned int> head, tail;
+
+};
+
+
+#endif // _INPUT_QUEUE_INCLUDE
@@ -0,0 +1,207 @@
+#include <iostream>
+#include <cstring>
+#include "InputReplay.h"
+
+
+using namespace std;
+
+
+InputRecorder::InputRecorder()
+{
+	recording = false;
+}
+
+InputRecorder::~InputRecorder()
+{
+	stop();
+}
+
+
+bool InputRecorder::start(const string &filename)
+{
+	fout.open(filename.c_str(), ios::out | ios::binary | ios::trunc);
+	if(!fout.is_open())
+		return false;
+	fout.write(REPLAY_MAGIC, 4);
+	writeUint32(REPLAY_VERSION);
+	recording = true;
+
+	return true;
+}
+
+void InputRecorder::stop()
+{
+	if(recording)
+		fout.close();
+	recording = false;
+}
+
+void InputRecorder::recordInput(const vector<InputEvent> &events)
+{
+	if(!recording)
+		return;
+	writeVarint((unsigned int)events.size());
+	for(unsigned int i=0; i<events.size(); i++)
+		writeUint16((events[i].key << 1) | (events[i].pressed ? 1 : 0));
+}
+
+void InputRecorder::recordState(unsigned int stateHash)
+{
+	if(recording)
+		writeUint32(stateHash);
+}
+
+void InputRecorder::writeVarint(unsigned int value)
+{
+	while(value >= 0x80)
+	{
+		fout.put(char((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	fout.put(char(value));
+}
+
+void InputRecorder::writeUint16(unsigned int value)
+{
+	fout.put(char(value & 0xff));
+	fout.put(char((value >> 8) & 0xff));
+}
+
+void InputRecorder::writeUint32(unsigned int value)
+{
+	for(int i=0; i<4; i++)
+		fout.put(char((value >> (8 * i)) & 0xff));
+}
+
+
+InputReplayer::InputReplayer()
+{
+	playing = false;
+	tick = nDivergences = 0;
+	firstDivergence = -1;
+	expectedHash = 0;
+}
+
+
+bool InputReplayer::start(const string &filename)
+{
+	char magic[4];
+	unsigned int version;
+
+	fin.open(filename.c_str(), ios::in | ios::binary);
+	if(!fin.is_open())
+		return false;
+	fin.read(magic, 4);
+	if(!fin || strncmp(magic, REPLAY_MAGIC, 4) != 0 || !readUint32(version) || version != REPLAY_VERSION)
+	{
+		cout << "Not a valid replay file: " << filename << endl;
+		fin.close();
+		return false;
+	}
+	tick = nDivergences = 0;
+	firstDivergence = -1;
+	playing = true;
+
+	return true;
+}
+
+void InputReplayer::stop()
+{
+	if(!playing)
+		return;
+	fin.close();
+	playing = false;
+	if(nDivergences == 0)
+		cout << "Replay finished after " << tick << " ticks, no divergence" << endl;
+	else
+		cout << "Replay finished after " << tick << " ticks, " << nDivergences
+			 << " ticks diverged (first at tick " << firstDivergence << ")" << endl;
+}
+
+bool InputReplayer::replayInput(vector<InputEvent> &events)
+{
+	unsigned int nEvents, code;
+	InputEvent event;
+
+	if(!playing)
+		return false;
+	if(!readVarint(nEvents))
+	{
+		stop();
+		return false;
+	}
+	// Ticks are replayed at their own pace, the original times are not needed
+	event.time = 0.0;
+	for(unsigned int i=0; i<nEvents; i++)
+	{
+		if(!readUint16(code))
+			break;
+		event.key = int(code >> 1);
+		event.pressed = (code & 1) != 0;
+		events.push_back(event);
+	}
+	if(!readUint32(expectedHash))
+	{
+		stop();
+		return false;
+	}
+
+	return true;
+}
+
+void InputReplayer::checkState(unsigned int stateHash)
+{
+	if(!playing)
+		return;
+	if(stateHash != expectedHash)
+	{
+		if(nDivergences == 0)
+		{
+			firstDivergence = tick;
+			cout << "Replay diverged at tick " << tick << hex << " (expected state 0x" << expectedHash
+				 << ", got 0x" << stateHash << ")" << dec << endl;
+		}
+		nDivergences++;
+	}
+	tick++;
+}
+
+bool InputReplayer::readVarint(unsigned int &value)
+{
+	int c, shift = 0;
+
+	value = 0;
+	do
+	{
+		c = fin.get();
+		if(c == EOF || shift > 28)
+			return false;
+		value |= (unsigned int)(c & 0x7f) << shift;
+		shift += 7;
+	} while(c & 0x80);
+
+	return true;
+}
+
+bool InputReplayer::readUint16(unsigned int &value)
+{
+	unsigned char bytes[2];
+
+	if(!fin.read((char *)bytes, 2))
+		return false;
+	value = bytes[0] | (bytes[1] << 8);
+
+	return true;
+}
+
+bool InputReplayer::readUint32(unsigned int &value)
+{
+	unsigned char bytes[4];
+
+	if(!fin.read((char *)bytes, 4))
+		return false;
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+
+	return true;
+}
+
@@ -0,0 +1,93 @@
+#ifndef _INPUT_REPLAY_INCLUDE
+#define _INPUT_REPLAY_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "InputQueue.h"
+
+
+using namespace std;
+
+
+// Replay files start with a small header followed by one record per
+// simulation tick. The tick number is implicit (the record index).
+// Each record holds the key events latched before the tick, in the order
+// they happened, and a hash of the game state after it:
+//
+//   varint nEvents, nEvents x uint16 (key << 1 | pressed), uint32 stateHash
+
+
+#define REPLAY_MAGIC "VJIR"
+#define REPLAY_VERSION 1
+
+
+// InputRecorder logs the key events of every tick to a file
+
+
+class InputRecorder
+{
+
+public:
+	InputRecorder();
+	~InputRecorder();
+
+	bool start(const string &filename);
+	void stop();
+	bool isRecording() const { return recording; }
+
+	// Call at the start of each tick with the events the tick will apply
+	void recordInput(const vector<InputEvent> &events);
+	// Call at the end of each tick with the hash of the resulting state
+	void recordState(unsigned int stateHash);
+
+private:
+	void writeVarint(unsigned int value);
+	void writeUint16(unsigned int value);
+	void writeUint32(unsigned int value);
+
+private:
+	ofstream fout;
+	bool recording;
+
+};
+
+
+// InputReplayer feeds the recorded events back to the game, tick by tick,
+// and flags the first tick whose state hash differs from the recorded one
+
+
+class InputReplayer
+{
+
+public:
+	InputReplayer();
+
+	bool start(const string &filename);
+	void stop();
+	bool isPlaying() const { return playing; }
+
+	// Appends the recorded events of the next tick. Returns false when
+	// the recording is over.
+	bool replayInput(vector<InputEvent> &events);
+	// Compares the state after the tick with the recorded one
+	void checkState(unsigned int stateHash);
+
+	int divergences() const { return nDivergences; }
+
+private:
+	bool readVarint(unsigned int &value);
+	bool readUint16(unsigned int &value);
+	bool readUint32(unsigned int &value);
+
+private:
+	ifstream fin;
+	bool playing;
+	int tick, nDivergences, firstDivergence;
+	unsigned int expectedHash;
+
+};
+
+
+#endif // _INPUT_REPLAY_INCLUDE
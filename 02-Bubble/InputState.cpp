@@ -0,0 +1,32 @@
+#include "InputState.h"
+
+
+void InputState::beginTick()
+{
+	pressed.reset();
+	released.reset();
+}
+
+void InputState::apply(const InputEvent &event)
+{
+	if(!validKey(event.key))
+		return;
+	if(event.pressed)
+	{
+		if(!down[event.key])
+			pressed.set(event.key);
+		down.set(event.key);
+	}
+	else
+	{
+		if(down[event.key])
+			released.set(event.key);
+		down.reset(event.key);
+	}
+}
+
+void InputState::releaseAll()
+{
+	released |= down;
+	down.reset();
+}
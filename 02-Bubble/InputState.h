@@ -0,0 +1,42 @@
+#ifndef _INPUT_STATE_INCLUDE
+#define _INPUT_STATE_INCLUDE
+
+
+#include <bitset>
+#include <GLFW/glfw3.h>
+#include "InputQueue.h"
+
+
+#define INPUT_KEYS (GLFW_KEY_LAST+1)
+
+
+// InputState is the key state seen by one simulation tick. Besides which
+// keys are down, it remembers which ones were pressed or released since the
+// previous tick, so a press and release that both land within one tick is
+// still seen by the update.
+
+
+class InputState
+{
+
+public:
+	// Forgets the edges of the previous tick
+	void beginTick();
+	void apply(const InputEvent &event);
+	// Releases every key that is down (e.g. when a replay ends)
+	void releaseAll();
+
+	// Down now, or pressed and released again during this tick
+	bool isDown(int key) const { return validKey(key) && (down[key] || pressed[key]); }
+	bool wasPressed(int key) const { return validKey(key) && pressed[key]; }
+	bool wasReleased(int key) const { return validKey(key) && released[key]; }
+
+	static bool validKey(int key) { return key >= 0 && key < INPUT_KEYS; }
+
+private:
+	std::bitset<INPUT_KEYS> down, pressed, released;
+
+};
+
+
+#endif // _INPUT_STATE_INCLUDE
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <GL/glew.h>
 #include "Player.h"
+#include "Profiler.h"
 #include "Game.h"
 
 
@@ -16,11 +17,19 @@ enum PlayerAnims
 };
 
 
-void Player::init(const glm::ivec2 &tileMapPos, ShaderProgram &shaderProgram)
+Player::~Player()
+{
+	AssetCache::instance().release(spritesheet);
+}
+
+
+void Player::init(const glm::ivec2 &tileMapPos)
 {
 	bJumping = false;
-	spritesheet.loadFromFile("images/SoaringEagleSpritesheet.png", TEXTURE_PIXEL_FORMAT_RGBA);
-	sprite = Sprite::createSprite(glm::ivec2(32, 32), glm::vec2(0.125, 0.125), &spritesheet, &shaderProgram);
+	// In headless mode there is no OpenGL context, the sprite only animates
+	if(!Game::instance().isHeadless())
+		spritesheet = AssetCache::instance().loadTexture("images/SoaringEagleSpritesheet.png", TEXTURE_PIXEL_FORMAT_RGBA);
+	sprite = Sprite::createSprite(glm::ivec2(32, 32), glm::vec2(0.125, 0.125), spritesheet);
 	sprite->setNumberAnimations(7);
 	
 		sprite->setAnimationSpeed(STAND_LEFT, 8);
@@ -56,8 +65,9 @@ void Player::init(const glm::ivec2 &tileMapPos, ShaderProgram &shaderProgram)
 	
 }
 
-void Player::update(int deltaTime)
+void Player::update(float deltaTime)
 {
+	PROFILE_SCOPE("Player::update");
 	sprite->update(deltaTime);
 	if(Game::instance().getKey(GLFW_KEY_LEFT))
 	{
@@ -163,12 +173,7 @@ void Player::update(int deltaTime)
 		}
 	}
 	
-	sprite->setPosition(glm::vec2(float(tileMapDispl.x + posPlayer.x), float(tileMapDispl.y + posPlayer.y)));
-}
-
-void Player::render()
-{
-	sprite->render();
+	sprite->moveTo(glm::vec2(float(tileMapDispl.x + posPlayer.x), float(tileMapDispl.y + posPlayer.y)));
 }
 
 void Player::setTileMap(TileMap *tileMap)
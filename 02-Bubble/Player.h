@@ -14,19 +14,21 @@ class Player
 {
 
 public:
-	void init(const glm::ivec2 &tileMapPos, ShaderProgram &shaderProgram);
-	void update(int deltaTime);
-	void render();
+	~Player();
+
+	void init(const glm::ivec2 &tileMapPos);
+	void update(float deltaTime);
 	
 	void setTileMap(TileMap *tileMap);
 	void setPosition(const glm::vec2 &pos);
 	glm::vec2 getPosition() const { return glm::vec2(posPlayer); }
+	const Sprite *getSprite() const { return sprite; }
 	
 private:
 	bool bJumping;
 	glm::ivec2 tileMapDispl, posPlayer;
 	int jumpAngle, startY;
-	Texture spritesheet;
+	TextureHandle spritesheet;
 	Sprite *sprite;
 	TileMap *map;
 };
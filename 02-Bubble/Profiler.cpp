@@ -0,0 +1,153 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+static thread_local ProfileRing *currentRing = NULL;
+
+
+Profiler::Profiler()
+{
+	epoch = 0;
+	epoch = now();
+}
+
+Profiler::~Profiler()
+{
+	for(unsigned int i=0; i<rings.size(); i++)
+		delete rings[i];
+}
+
+
+void Profiler::setThreadName(const string &name)
+{
+	ProfileRing *ring = threadRing();
+	lock_guard<mutex> lock(ringsMutex);
+
+	ring->threadName = name;
+}
+
+long long Profiler::now() const
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count() - epoch;
+}
+
+void Profiler::record(const char *name, long long start, long long end)
+{
+	record(threadRing(), name, start, end);
+}
+
+ProfileRing *Profiler::createTrack(const string &name)
+{
+	ProfileRing *track = registerRing();
+	lock_guard<mutex> lock(ringsMutex);
+
+	track->threadName = name;
+
+	return track;
+}
+
+void Profiler::record(ProfileRing *ring, const char *name, long long start, long long end)
+{
+	unsigned int head = ring->head.load(memory_order_relaxed);
+	ProfileZone &zone = ring->zones[head % PROFILER_RING_SIZE];
+
+	zone.name = name;
+	zone.start = start;
+	zone.end = end;
+	// Release so a dump that sees the new head also sees the zone
+	ring->head.store(head + 1, memory_order_release);
+}
+
+ProfileRing *Profiler::threadRing()
+{
+	if(currentRing == NULL)
+		currentRing = registerRing();
+
+	return currentRing;
+}
+
+ProfileRing *Profiler::registerRing()
+{
+	ProfileRing *ring = new ProfileRing();
+	lock_guard<mutex> lock(ringsMutex);
+
+	ring->head = 0;
+	ring->threadId = int(rings.size()) + 1;
+	ring->threadName = "Thread " + to_string(ring->threadId);
+	rings.push_back(ring);
+
+	return ring;
+}
+
+// Names are string literals or thread names, only quotes and backslashes need escaping
+
+static string jsonString(const char *str)
+{
+	string escaped = "\"";
+
+	for(; *str != '\0'; str++)
+	{
+		if(*str == '"' || *str == '\\')
+			escaped += '\\';
+		escaped += *str;
+	}
+	escaped += '"';
+
+	return escaped;
+}
+
+bool Profiler::dumpChromeTrace(const string &filename)
+{
+	ofstream fout;
+	vector<ProfileZone> zones;
+	unsigned int head, first, firstValid;
+	bool bFirst = true;
+
+	fout.open(filename.c_str(), ios::out | ios::trunc);
+	if(!fout.is_open())
+	{
+		cout << "Cannot write trace " << filename << endl;
+		return false;
+	}
+	lock_guard<mutex> lock(ringsMutex);
+	fout << "{\"traceEvents\":[" << endl;
+	fout.setf(ios::fixed);
+	fout.precision(3);
+	for(unsigned int r=0; r<rings.size(); r++)
+	{
+		ProfileRing *ring = rings[r];
+
+		if(!bFirst)
+			fout << "," << endl;
+		bFirst = false;
+		fout << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadId
+			 << ",\"args\":{\"name\":" << jsonString(ring->threadName.c_str()) << "}}";
+
+		// Copy the ring, then drop the zones the owner may have overwritten meanwhile
+		head = ring->head.load(memory_order_acquire);
+		first = head > PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE : 0;
+		zones.clear();
+		for(unsigned int i=first; i!=head; i++)
+			zones.push_back(ring->zones[i % PROFILER_RING_SIZE]);
+		head = ring->head.load(memory_order_acquire);
+		// Slot head - PROFILER_RING_SIZE is the one the owner may be writing now
+		firstValid = head >= PROFILER_RING_SIZE ? head - PROFILER_RING_SIZE + 1 : 0;
+		for(unsigned int i=0; i<zones.size(); i++)
+		{
+			if(first + i < firstValid)
+				continue;
+			fout << "," << endl << "{\"name\":" << jsonString(zones[i].name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->threadId
+				 << ",\"ts\":" << zones[i].start / 1000.0 << ",\"dur\":" << (zones[i].end - zones[i].start) / 1000.0 << "}";
+		}
+	}
+	fout << endl << "]}" << endl;
+	fout.close();
+	cout << "Trace written to " << filename << endl;
+
+	return true;
+}
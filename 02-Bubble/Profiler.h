@@ -0,0 +1,122 @@
+#ifndef _PROFILER_INCLUDE
+#define _PROFILER_INCLUDE
+
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// Profiling is compiled in for debug builds. Release builds (NDEBUG) remove
+// every zone unless PROFILER_ENABLED is defined explicitly.
+
+#if !defined(NDEBUG) && !defined(PROFILER_ENABLED)
+#define PROFILER_ENABLED
+#endif
+
+#define PROFILER_RING_SIZE 65536 // Zones kept per thread, older ones are overwritten
+
+
+using namespace std;
+
+
+// A finished zone. Name must be a string literal (only the pointer is stored).
+
+struct ProfileZone
+{
+	const char *name;
+	long long start, end; // Nanoseconds since the profiler started
+};
+
+
+// Every thread that opens a zone gets its own ring, so recording never
+// takes a lock: the owning thread writes the slot and then advances head,
+// the thread dumping the trace only reads.
+
+struct ProfileRing
+{
+	ProfileZone zones[PROFILER_RING_SIZE];
+	atomic<unsigned int> head;
+	int threadId;
+	string threadName;
+};
+
+
+// Profiler collects timed zones from all threads and writes them as
+// Chrome trace_event JSON (load it in chrome://tracing or Perfetto).
+
+
+class Profiler
+{
+
+private:
+	Profiler();
+
+public:
+	static Profiler &instance()
+	{
+		static Profiler P;
+
+		return P;
+	}
+
+	~Profiler();
+
+	// Names the calling thread in the trace
+	void setThreadName(const string &name);
+
+	long long now() const;
+	void record(const char *name, long long start, long long end);
+
+	// Extra tracks hold zones that do not belong to a CPU thread (GPU timings).
+	// Each track must only be written from one thread at a time.
+	ProfileRing *createTrack(const string &name);
+	void record(ProfileRing *track, const char *name, long long start, long long end);
+
+	// Safe to call while other threads keep recording
+	bool dumpChromeTrace(const string &filename);
+
+private:
+	ProfileRing *threadRing();
+	ProfileRing *registerRing();
+
+private:
+	long long epoch;
+	mutex ringsMutex; // Only taken when a thread registers and when dumping
+	vector<ProfileRing *> rings;
+
+};
+
+
+// ProfileScope times the block it lives in
+
+class ProfileScope
+{
+
+public:
+	ProfileScope(const char *name) : name(name) { start = Profiler::instance().now(); }
+	~ProfileScope() { Profiler::instance().record(name, start, Profiler::instance().now()); }
+
+private:
+	const char *name;
+	long long start;
+
+};
+
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#ifdef PROFILER_ENABLED
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_THREAD(name) Profiler::instance().setThreadName(name)
+#define PROFILE_DUMP(filename) Profiler::instance().dumpChromeTrace(filename)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_THREAD(name)
+#define PROFILE_DUMP(filename) false
+#endif
+
+
+#endif // _PROFILER_INCLUDE
@@ -0,0 +1,100 @@
+#include <iostream>
+#include "RenderTarget.h"
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+RenderTarget::RenderTarget()
+{
+	framebuffer = colorBuffer = 0;
+	size = glm::ivec2(0);
+}
+
+RenderTarget::~RenderTarget()
+{
+}
+
+
+bool RenderTarget::init(int width, int height)
+{
+	GLenum status;
+
+	free();
+	size = glm::ivec2(width, height);
+	// Only ever blitted, a renderbuffer is enough
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	if(status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		cout << "Render target incomplete (0x" << hex << status << dec << ")" << endl;
+		free();
+		return false;
+	}
+
+	return true;
+}
+
+void RenderTarget::free()
+{
+	if(framebuffer != 0)
+		glDeleteFramebuffers(1, &framebuffer);
+	if(colorBuffer != 0)
+		glDeleteRenderbuffers(1, &colorBuffer);
+	framebuffer = colorBuffer = 0;
+}
+
+void RenderTarget::bind(const glm::ivec2 &windowSize) const
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	if(framebuffer == 0)
+	{
+		glm::ivec4 rect = presentRect(windowSize);
+
+		glViewport(rect.x, rect.y, rect.z, rect.w);
+	}
+	else
+		glViewport(0, 0, size.x, size.y);
+}
+
+void RenderTarget::present(const glm::ivec2 &windowSize) const
+{
+	PROFILE_SCOPE("RenderTarget::present");
+	glm::ivec4 rect = presentRect(windowSize);
+
+	if(framebuffer == 0)
+		return;
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	// The bars, the blit covers the rest
+	glClearColor(0.f, 0.f, 0.f, 1.f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glBlitFramebuffer(0, 0, size.x, size.y, rect.x, rect.y, rect.x + rect.z, rect.y + rect.w, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Integer factors keep every game pixel the same size on screen. A window
+// smaller than the target gets it shrunk to fit, keeping the aspect ratio.
+
+glm::ivec4 RenderTarget::presentRect(const glm::ivec2 &windowSize) const
+{
+	int scale = glm::min(windowSize.x / size.x, windowSize.y / size.y);
+	glm::ivec2 scaledSize;
+
+	if(scale >= 1)
+		scaledSize = scale * size;
+	else if(windowSize.x * size.y < windowSize.y * size.x)
+		scaledSize = glm::ivec2(windowSize.x, windowSize.x * size.y / size.x);
+	else
+		scaledSize = glm::ivec2(windowSize.y * size.x / size.y, windowSize.y);
+
+	return glm::ivec4((windowSize - scaledSize) / 2, scaledSize);
+}
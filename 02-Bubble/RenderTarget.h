@@ -0,0 +1,43 @@
+#ifndef _RENDER_TARGET_INCLUDE
+#define _RENDER_TARGET_INCLUDE
+
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+
+// RenderTarget is an offscreen framebuffer the scene is drawn into at its
+// native resolution, so every fragment shader runs once per game pixel.
+// present() scales it to the window in a single nearest neighbour blit,
+// by the largest integer factor that fits, and fills the rest of the
+// window with black bars (it changes the clear color).
+
+
+class RenderTarget
+{
+
+public:
+	RenderTarget();
+	~RenderTarget();
+
+	// These methods should be called with an active OpenGL context
+	bool init(int width, int height);
+	void free();
+
+	// Following draws go to the target, which covers the whole viewport.
+	// If init() failed they go straight to the window, where present() would
+	// have put them.
+	void bind(const glm::ivec2 &windowSize) const;
+	void present(const glm::ivec2 &windowSize) const;
+
+	// Where present() puts the image inside a window of the given size
+	glm::ivec4 presentRect(const glm::ivec2 &windowSize) const;
+
+private:
+	GLuint framebuffer, colorBuffer;
+	glm::ivec2 size;
+
+};
+
+
+#endif // _RENDER_TARGET_INCLUDE
@@ -2,6 +2,11 @@
 #include <cmath>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Scene.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "ShaderNames.h"
+#include "TextureAtlas.h"
+#include "AssetCache.h"
 #include "Game.h"
 #include "Troll.h" 
 
@@ -9,23 +14,25 @@
 #define SCREEN_X 0
 #define SCREEN_Y 0
 
+#define LEVEL_FILE "levels/Nivel01.txt"
+
 #define INIT_PLAYER_X_TILES 4
 #define INIT_PLAYER_Y_TILES 10
 
 
 Scene::Scene()
 {
-	back = NULL;
 	map = NULL;
 	player = NULL;
 	troll1 = NULL;
 	troll2 = NULL;
+	troll3 = NULL;
+	troll4 = NULL;
+	tileRenderMode = TILEMAP_RENDER_GEOMETRY;
 }
 
 Scene::~Scene()
 {
-	if (back != NULL)
-		delete back;
 	if(map != NULL)
 		delete map;
 	if(player != NULL)
@@ -34,43 +41,76 @@ Scene::~Scene()
 		delete troll1;
 	if (troll2 != NULL) 
 		delete troll2;
+	if (troll3 != NULL)
+		delete troll3;
+	if (troll4 != NULL)
+		delete troll4;
+	AssetCache::instance().release(mapProgram);
+	AssetCache::instance().release(spriteProgram);
+	AssetCache::instance().release(tileProgram);
 }
 
 
 void Scene::init()
 {
-	initShaders();
-	back = TileMap::createTileMap("levels/Fondo.txt", glm::vec2(SCREEN_X, SCREEN_Y), texProgram);
-	map = TileMap::createTileMap("levels/Mapa.txt", glm::vec2(SCREEN_X, SCREEN_Y), texProgram);
+	PROFILE_SCOPE("Scene::init");
+	AssetCache &assets = AssetCache::instance();
+	vector<LayerHandle> levelLayers;
+
+	if(Game::instance().isHeadless())
+	{
+		// Only collision data is needed to simulate, the map is never drawn
+		map = TileMap::createTileMap(LEVEL_FILE);
+	}
+	else
+	{
+		// The level files are parsed while the shaders compile
+		TileMap::preloadLevel(LEVEL_FILE, levelLayers);
+		initShaders();
+		initTextures();
+		gpuTimer.init();
+		frameUniforms.init();
+		spriteBatch.init(*assets.get(spriteProgram));
+		// Background and foreground are layers of the same map, drawn at once
+		map = TileMap::createTileMap(LEVEL_FILE, glm::vec2(SCREEN_X, SCREEN_Y), *assets.get(mapProgram));
+		map->prepareLookup(*assets.get(tileProgram));
+		setTileRenderMode(tileRenderMode);
+		for(unsigned int i=0; i<levelLayers.size(); i++)
+			assets.release(levelLayers[i]);
+	}
 	
 	player = new Player();
-	player->init(glm::ivec2(SCREEN_X, SCREEN_Y), texProgram);
+	player->init(glm::ivec2(SCREEN_X, SCREEN_Y));
 	player->setPosition(glm::vec2(INIT_PLAYER_X_TILES * map->getTileSize(), INIT_PLAYER_Y_TILES * map->getTileSize()));
 	player->setTileMap(map);
 
 	troll1 = new Troll();
-	troll1->init(glm::ivec2(SCREEN_X, SCREEN_Y), texProgram);
+	troll1->init(glm::ivec2(SCREEN_X, SCREEN_Y));
 	troll1->setPosition(glm::vec2(20 * map->getTileSize(), 5 * map->getTileSize()));
 	troll1->setTileMap(map);
 
 	troll2 = new Troll();
-	troll2->init(glm::ivec2(SCREEN_X, SCREEN_Y), texProgram);
+	troll2->init(glm::ivec2(SCREEN_X, SCREEN_Y));
 	troll2->setPosition(glm::vec2(40 * map->getTileSize(), 5 * map->getTileSize()));
 	troll2->setTileMap(map);
 
 	troll3 = new Troll(); 
-	troll3->init(glm::ivec2(SCREEN_X, SCREEN_Y), texProgram);
+	troll3->init(glm::ivec2(SCREEN_X, SCREEN_Y));
 	troll3->setPosition(glm::vec2(25 * map->getTileSize(), 5 * map->getTileSize()));
 	troll3->setTileMap(map);
 
 	troll4 = new Troll();  
-	troll4->init(glm::ivec2(SCREEN_X, SCREEN_Y), texProgram);
+	troll4->init(glm::ivec2(SCREEN_X, SCREEN_Y));
 	troll4->setPosition(glm::vec2(30 * map->getTileSize(), 5 * map->getTileSize()));
 	troll4->setTileMap(map);
 
+	// Whatever a previous scene loaded and this one does not use
+	assets.collectUnused();
 
 	projection = glm::ortho(0.f, float(SCREEN_WIDTH), float(SCREEN_HEIGHT), 0.f);
-	currentTime = 0.0f;
+	cameraUpdate();
+	prevCameraPos = cameraPos;
+	currentTime = tickDeltaTime = 0.0f;
 }
 
 void Scene::cameraUpdate() {
@@ -89,13 +129,16 @@ void Scene::cameraUpdate() {
 	camX = glm::clamp(camX, 0.0f, maxCamX);
 	camY = glm::clamp(camY, 0.0f, maxCamY);
 
-	// Actualizar la proyeccin con la nueva posicin de la cmara
-	projection = glm::ortho(camX, camX + SCREEN_WIDTH, camY + SCREEN_HEIGHT, camY);
+	// La proyeccin se calcula en render() interpolando entre ticks
+	cameraPos = glm::vec2(camX, camY);
 }
 
-void Scene::update(int deltaTime)
+void Scene::update(float deltaTime)
 {
+	PROFILE_SCOPE("Scene::update");
 	currentTime += deltaTime;
+	tickDeltaTime = deltaTime;
+	prevCameraPos = cameraPos;
 	player->update(deltaTime);
 	troll1->update(deltaTime, player->getPosition());
 	troll2->update(deltaTime, player->getPosition());
@@ -104,53 +147,142 @@ void Scene::update(int deltaTime)
 	cameraUpdate();
 }
 
-void Scene::render()
+void Scene::snapshot(SceneSnapshot& snapshot) const
 {
-	glm::mat4 modelview;
+	PROFILE_SCOPE("Scene::snapshot");
+	const Troll* trolls[4] = { troll1, troll2, troll3, troll4 };
+	SpriteDraw draw;
 
-	texProgram.use();
-	texProgram.setUniformMatrix4f("projection", projection);
-	texProgram.setUniform4f("color", 1.0f, 1.0f, 1.0f, 1.0f);
-	modelview = glm::mat4(1.0f);
-	texProgram.setUniformMatrix4f("modelview", modelview);
-	texProgram.setUniform2f("texCoordDispl", 0.f, 0.f);
-	back->render();
-	map->render();
-	player->render();
-	troll1->render();
-	troll2->render();
-	troll3->render(); 
-	troll4->render();
+	snapshot.deltaTime = tickDeltaTime;
+	snapshot.gameTime = currentTime;
+	snapshot.cameraPos = cameraPos;
+	snapshot.prevCameraPos = prevCameraPos;
+	// clear() keeps the capacity, so snapshots stop allocating after a few ticks
+	snapshot.sprites.clear();
+	draw.sprite = player->getSprite();
+	draw.state = draw.sprite->getState();
+	snapshot.sprites.push_back(draw);
+	for (int i = 0; i < 4; i++)
+	{
+		if (trolls[i]->isActive()) // Solo se renderizan los Trolls activos
+		{
+			draw.sprite = trolls[i]->getSprite();
+			draw.state = draw.sprite->getState();
+			snapshot.sprites.push_back(draw);
+		}
+	}
 }
 
-void Scene::initShaders()
+// Alpha in [0, 1) is how far we are between the last two simulation ticks.
+// Camera and sprites are interpolated so motion stays smooth at any framerate.
+
+void Scene::render(const SceneSnapshot& snapshot, float alpha)
 {
-	Shader vShader, fShader;
+	PROFILE_SCOPE("Scene::render");
+	glm::mat4 modelview;
+	glm::vec2 camera = glm::mix(snapshot.prevCameraPos, snapshot.cameraPos, alpha);
+	glm::vec2 viewMax;
+	FrameData frameData;
+	ShaderProgram &program = *AssetCache::instance().get(mapProgram);
 
-	vShader.initFromFile(VERTEX_SHADER, "shaders/texture.vert");
-	if(!vShader.isCompiled())
+	gpuTimer.beginFrame();
+	viewMax = camera + glm::vec2(float(SCREEN_WIDTH), float(SCREEN_HEIGHT));
+	projection = glm::ortho(camera.x, viewMax.x, viewMax.y, camera.y);
+	// Uniforms shared by every program, uploaded once per frame
+	frameData.projection = projection;
+	frameData.screenSize = glm::vec2(float(SCREEN_WIDTH), float(SCREEN_HEIGHT));
+	frameData.time = (snapshot.gameTime - (1.f - alpha) * snapshot.deltaTime) / 1000.f;
+	frameData.padding = 0.f;
+	frameUniforms.update(frameData);
+	program.use();
+	modelview = glm::mat4(1.0f);
+	program.setUniformMatrix4f(UNIFORM_MODELVIEW, modelview);
 	{
-		cout << "Vertex Shader Error" << endl;
-		cout << "" << vShader.log() << endl << endl;
+		GpuScope pass(gpuTimer, "Map");
+		// Tiles changed by the simulation since the last frame
+		map->uploadEdits();
+		map->render(camera, viewMax);
 	}
-	fShader.initFromFile(FRAGMENT_SHADER, "shaders/texture.frag");
-	if(!fShader.isCompiled())
 	{
-		cout << "Fragment Shader Error" << endl;
-		cout << "" << fShader.log() << endl << endl;
+		GpuScope pass(gpuTimer, "Sprites");
+		spriteBatch.begin();
+		for (unsigned int i = 0; i < snapshot.sprites.size(); i++)
+			snapshot.sprites[i].sprite->render(spriteBatch, snapshot.sprites[i].state, alpha);
+		spriteBatch.end();
 	}
-	texProgram.init();
-	texProgram.addShader(vShader);
-	texProgram.addShader(fShader);
-	texProgram.link();
-	if(!texProgram.isLinked())
+	gpuTimer.endFrame();
+}
+
+// FNV-1a over the positions and spawn state of every entity
+
+static unsigned int hashInt(unsigned int hash, int value)
+{
+	for(int i=0; i<4; i++)
 	{
-		cout << "Shader Linking Error" << endl;
-		cout << "" << texProgram.log() << endl << endl;
+		hash ^= (unsigned int)(value >> (8 * i)) & 0xff;
+		hash *= 16777619u;
 	}
-	texProgram.bindFragmentOutput("outColor");
-	vShader.free();
-	fShader.free();
+	return hash;
+}
+
+unsigned int Scene::stateHash() const
+{
+	const Troll *trolls[4] = { troll1, troll2, troll3, troll4 };
+	unsigned int hash = 2166136261u;
+
+	hash = hashInt(hash, int(player->getPosition().x));
+	hash = hashInt(hash, int(player->getPosition().y));
+	for(int i=0; i<4; i++)
+	{
+		hash = hashInt(hash, trolls[i]->isActive() ? 1 : 0);
+		hash = hashInt(hash, int(trolls[i]->getPosition().x));
+		hash = hashInt(hash, int(trolls[i]->getPosition().y));
+	}
+
+	return hash;
+}
+
+void Scene::initShaders()
+{
+	PROFILE_SCOPE("Scene::initShaders");
+	AssetCache &assets = AssetCache::instance();
+	ShaderCache cache;
+
+	// Compiled in parallel where supported, or loaded from the binary cache.
+	// Programs some other scene already loaded are just shared.
+	mapProgram = assets.loadProgram("shaders/tiles.vert", "shaders/texture.frag", cache);
+	spriteProgram = assets.loadProgram("shaders/sprite.vert", "shaders/sprite.frag", cache);
+	tileProgram = assets.loadProgram("shaders/tilemap.vert", "shaders/tilemap.frag", cache);
+	cache.build();
+	ShaderProgram &mapShader = *assets.get(mapProgram), &tileShader = *assets.get(tileProgram);
+	mapShader.bindFragmentOutput("outColor");
+	// The color never changes, uniforms keep their value between frames
+	mapShader.use();
+	mapShader.setUniform4f(UNIFORM_COLOR, 1.0f, 1.0f, 1.0f, 1.0f);
+	mapShader.setUniform1i(UNIFORM_TILE_ANIMATIONS, TILEMAP_ANIMATION_UNIT);
+	tileShader.use();
+	tileShader.setUniform1i(UNIFORM_TILESHEET, 0);
+	tileShader.setUniform1i(UNIFORM_TILE_MAP, TILEMAP_LOOKUP_UNIT);
+	tileShader.setUniform1i(UNIFORM_TILE_ANIMATIONS, TILEMAP_ANIMATION_UNIT);
+}
+
+void Scene::initTextures()
+{
+	PROFILE_SCOPE("Scene::initTextures");
+	TextureAtlas &atlas = TextureAtlas::instance();
+
+	// Textures later loaded from these files are regions of the atlas, so
+	// tiles and sprites share the texture binding
+	atlas.add("images/WhompEmTileSet.png");
+	atlas.add("images/SoaringEagleSpritesheet.png");
+	atlas.build();
+}
+
+void Scene::setTileRenderMode(TileRenderMode mode)
+{
+	tileRenderMode = mode;
+	if(map != NULL)
+		map->setRenderMode(mode);
 }
 
 
@@ -1,11 +1,35 @@
 #ifndef _SCENE_INCLUDE
 #define _SCENE_INCLUDE
 
+#include <vector>
 #include <glm/glm.hpp>
 #include "ShaderProgram.h"
+#include "AssetCache.h"
 #include "TileMap.h"
 #include "Player.h"
 #include "Troll.h"
+#include "GpuTimer.h"
+#include "FrameUniforms.h"
+#include "SpriteBatch.h"
+
+// Everything needed to draw the result of one simulation tick. The
+// simulation fills one in after updating and the renderer draws it,
+// possibly on another thread, without touching the entities.
+
+struct SpriteDraw
+{
+    const Sprite* sprite;
+    SpriteState state;
+};
+
+struct SceneSnapshot
+{
+    double time;       // Time (in seconds) the snapshot's state corresponds to
+    float deltaTime;   // Length of the tick that produced it (in milliseconds)
+    float gameTime;    // Simulated time at that tick (in milliseconds)
+    glm::vec2 cameraPos, prevCameraPos;
+    std::vector<SpriteDraw> sprites;
+};
 
 // Scene contains all the entities of our game.
 // It is responsible for updating and render them.
@@ -18,19 +42,34 @@ public:
 
     void init();
     void cameraUpdate();
-    void update(int deltaTime);
-    void render();
+    void update(float deltaTime);
+    void snapshot(SceneSnapshot& snapshot) const;
+    void render(const SceneSnapshot& snapshot, float alpha);
+
+    // Hash of player and troll positions, used to validate replays
+    unsigned int stateHash() const;
+
+    const GpuTimer& getGpuTimer() const { return gpuTimer; }
+
+    // Geometry (VBO) or lookup (tile index texture) drawing of the map
+    void setTileRenderMode(TileRenderMode mode);
+    TileRenderMode getTileRenderMode() const { return tileRenderMode; }
 
 private:
     void initShaders();
+    void initTextures();
 
 private:
     TileMap* map;
-    TileMap* back;
     Player* player;
-    ShaderProgram texProgram;
-    float currentTime;
+    ProgramHandle mapProgram, spriteProgram, tileProgram;
+    TileRenderMode tileRenderMode;
+    SpriteBatch spriteBatch;
+    GpuTimer gpuTimer;
+    FrameUniforms frameUniforms;
+    float currentTime, tickDeltaTime;
     glm::mat4 projection;
+    glm::vec2 cameraPos, prevCameraPos;
 
     Troll* troll1;
     Troll* troll2;
@@ -13,11 +13,16 @@ Shader::Shader()
 
 
 void Shader::initFromSource(const ShaderType type, const string &source)
+{
+	startCompile(type, source);
+	finishCompile();
+}
+
+void Shader::startCompile(const ShaderType type, const string &source)
 {
 	const char *sourcePtr = source.c_str();
-	GLint status;
-	char buffer[512];
 
+	compiled = false;
 	switch(type)
 	{
 	case VERTEX_SHADER:
@@ -31,6 +36,15 @@ void Shader::initFromSource(const ShaderType type, const string &source)
 		return;
 	glShaderSource(shaderId, 1, &sourcePtr, NULL);
 	glCompileShader(shaderId);
+}
+
+void Shader::finishCompile()
+{
+	GLint status;
+	char buffer[512];
+
+	if(shaderId == 0)
+		return;
 	glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
 	compiled = (status == GL_TRUE);
 	glGetShaderInfoLog(shaderId, 512, NULL, buffer);
@@ -29,13 +29,18 @@ public:
 	bool initFromFile(const ShaderType type, const string &filename);
 	void free();
 
+	// Split version of initFromSource: startCompile returns without waiting
+	// for the compiler, so several shaders can compile at the same time
+	// (see ShaderCache). finishCompile fetches the result.
+	void startCompile(const ShaderType type, const string &source);
+	void finishCompile();
+
+	static bool loadShaderSource(const string &filename, string &shaderSource);
+
 	GLuint getId() const;
 	bool isCompiled() const;
 	const string &log() const;
 
-private:
-	bool loadShaderSource(const string &filename, string &shaderSource);
-
 private:
 	GLuint shaderId;
 	bool compiled;
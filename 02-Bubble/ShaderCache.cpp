@@ -0,0 +1,223 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "ShaderCache.h"
+#include "Profiler.h"
+
+
+#define CACHE_MAGIC "VJSC"
+#define CACHE_VERSION 1
+
+
+using namespace std;
+
+
+// 64-bit FNV-1a, only used to name the cache files
+
+static unsigned long long hashString(const string &str, unsigned long long hash = 14695981039346656037ull)
+{
+	for(unsigned int i=0; i<str.size(); i++)
+	{
+		hash ^= (unsigned char)str[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static void makeDirectory(const string &path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+static void writeUint32(ofstream &fout, unsigned int value)
+{
+	for(int i=0; i<4; i++)
+		fout.put(char((value >> (8 * i)) & 0xff));
+}
+
+static bool readUint32(ifstream &fin, unsigned int &value)
+{
+	unsigned char bytes[4];
+
+	if(!fin.read((char *)bytes, 4))
+		return false;
+	value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+
+	return true;
+}
+
+
+ShaderCache::ShaderCache(const string &directory)
+{
+	this->directory = directory;
+	bBinaries = false;
+}
+
+
+void ShaderCache::add(ShaderProgram &program, const string &vertexFile, const string &fragmentFile)
+{
+	Entry entry;
+
+	entry.program = &program;
+	entry.vertexFile = vertexFile;
+	entry.fragmentFile = fragmentFile;
+	entries.push_back(entry);
+}
+
+bool ShaderCache::build()
+{
+	PROFILE_SCOPE("ShaderCache::build");
+	vector<Entry *> pending;
+	string driver;
+	GLint nFormats = 0;
+	bool bSuccess = true;
+	char hash[32];
+
+	// Binaries are only valid for the exact driver that produced them
+	driver = string((const char *)glGetString(GL_VENDOR)) + "\n" + (const char *)glGetString(GL_RENDERER) + "\n" + (const char *)glGetString(GL_VERSION);
+	if(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nFormats);
+	bBinaries = nFormats > 0;
+	if(GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else if(GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	for(unsigned int i=0; i<entries.size(); i++)
+	{
+		Entry &entry = entries[i];
+
+		if(!Shader::loadShaderSource(entry.vertexFile, entry.vertexSource) || !Shader::loadShaderSource(entry.fragmentFile, entry.fragmentSource))
+		{
+			cout << "Cannot read shader " << entry.vertexFile << " or " << entry.fragmentFile << endl;
+			bSuccess = false;
+			continue;
+		}
+		snprintf(hash, sizeof(hash), "%016llx", hashString(driver, hashString(entry.fragmentSource, hashString(entry.vertexSource))));
+		entry.cacheFile = directory + "/" + hash + ".bin";
+		if(!bBinaries || !loadFromCache(entry, driver))
+			pending.push_back(&entry);
+	}
+
+	// Issue every compile, then every link, and only then wait for results
+	for(unsigned int i=0; i<pending.size(); i++)
+	{
+		pending[i]->vShader.startCompile(VERTEX_SHADER, pending[i]->vertexSource);
+		pending[i]->fShader.startCompile(FRAGMENT_SHADER, pending[i]->fragmentSource);
+	}
+	for(unsigned int i=0; i<pending.size(); i++)
+	{
+		ShaderProgram *program = pending[i]->program;
+
+		program->init();
+		program->addShader(pending[i]->vShader);
+		program->addShader(pending[i]->fShader);
+		program->startLink(bBinaries);
+	}
+	for(unsigned int i=0; i<pending.size(); i++)
+	{
+		Entry &entry = *pending[i];
+
+		entry.program->finishLink();
+		if(!entry.program->isLinked())
+		{
+			entry.vShader.finishCompile();
+			entry.fShader.finishCompile();
+			if(!entry.vShader.isCompiled())
+			{
+				cout << "Vertex Shader Error (" << entry.vertexFile << ")" << endl;
+				cout << "" << entry.vShader.log() << endl << endl;
+			}
+			if(!entry.fShader.isCompiled())
+			{
+				cout << "Fragment Shader Error (" << entry.fragmentFile << ")" << endl;
+				cout << "" << entry.fShader.log() << endl << endl;
+			}
+			cout << "Shader Linking Error" << endl;
+			cout << "" << entry.program->log() << endl << endl;
+			bSuccess = false;
+		}
+		else if(bBinaries)
+			saveToCache(entry, driver);
+		entry.vShader.free();
+		entry.fShader.free();
+	}
+	entries.clear();
+
+	return bSuccess;
+}
+
+// Cache files: "VJSC", uint32 version, uint32 driver length, driver string,
+// uint32 binary format, uint32 binary length, binary
+
+bool ShaderCache::loadFromCache(Entry &entry, const string &driver)
+{
+	ifstream fin(entry.cacheFile.c_str(), ios::in | ios::binary);
+	char magic[4];
+	unsigned int version, length, format;
+	string cachedDriver;
+	vector<char> binary;
+	streamoff fileSize;
+
+	if(!fin.is_open())
+		return false;
+	fin.seekg(0, ios::end);
+	fileSize = fin.tellg();
+	fin.seekg(0, ios::beg);
+	fin.read(magic, 4);
+	if(!fin || string(magic, 4) != CACHE_MAGIC || !readUint32(fin, version) || version != CACHE_VERSION)
+		return false;
+	if(!readUint32(fin, length) || length > 4096)
+		return false;
+	cachedDriver.resize(length);
+	if(length > 0 && !fin.read(&cachedDriver[0], length))
+		return false;
+	if(cachedDriver != driver || !readUint32(fin, format) || !readUint32(fin, length) || length == 0)
+		return false;
+	// A corrupt length could ask for gigabytes, the binary must be in the file
+	if(streamoff(length) > fileSize - streamoff(fin.tellg()))
+	{
+		cout << "Shader cache file " << entry.cacheFile << " is truncated" << endl;
+		return false;
+	}
+	binary.resize(length);
+	if(!fin.read(&binary[0], length))
+		return false;
+	if(!entry.program->loadBinary(GLenum(format), &binary[0], GLsizei(length)))
+	{
+		// Rejected by the driver, build from source and overwrite it
+		entry.program->free();
+		return false;
+	}
+
+	return true;
+}
+
+void ShaderCache::saveToCache(const Entry &entry, const string &driver)
+{
+	vector<char> binary;
+	GLenum format;
+	ofstream fout;
+
+	if(!entry.program->getBinary(format, binary))
+		return;
+	makeDirectory(directory);
+	fout.open(entry.cacheFile.c_str(), ios::out | ios::binary | ios::trunc);
+	if(!fout.is_open())
+		return;
+	fout.write(CACHE_MAGIC, 4);
+	writeUint32(fout, CACHE_VERSION);
+	writeUint32(fout, (unsigned int)driver.size());
+	fout.write(driver.c_str(), driver.size());
+	writeUint32(fout, format);
+	writeUint32(fout, (unsigned int)binary.size());
+	fout.write(&binary[0], binary.size());
+}
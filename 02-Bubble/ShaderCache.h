@@ -0,0 +1,56 @@
+#ifndef _SHADER_CACHE_INCLUDE
+#define _SHADER_CACHE_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include "Shader.h"
+#include "ShaderProgram.h"
+
+
+#define SHADER_CACHE_DIR "shadercache"
+
+
+// ShaderCache builds all the shader programs needed at startup in one go.
+// Programs whose linked binary is in the cache directory are loaded from it.
+// Binaries are stored per source hash and driver, and are rebuilt from source
+// if anything changed. The rest are compiled together: every compile and
+// link is issued before any result is read back, so with
+// KHR_parallel_shader_compile the driver spreads them over its threads.
+// Freshly linked programs are saved for the next launch.
+
+
+class ShaderCache
+{
+
+public:
+	ShaderCache(const string &directory = SHADER_CACHE_DIR);
+
+	// Queues a program to be built from a vertex and a fragment shader file
+	void add(ShaderProgram &program, const string &vertexFile, const string &fragmentFile);
+
+	// Builds every queued program. Returns false if any of them failed.
+	bool build();
+
+private:
+	struct Entry
+	{
+		ShaderProgram *program;
+		string vertexFile, fragmentFile;
+		string vertexSource, fragmentSource;
+		string cacheFile;
+		Shader vShader, fShader;
+	};
+
+	bool loadFromCache(Entry &entry, const string &driver);
+	void saveToCache(const Entry &entry, const string &driver);
+
+private:
+	string directory;
+	vector<Entry> entries;
+	bool bBinaries;
+
+};
+
+
+#endif // _SHADER_CACHE_INCLUDE
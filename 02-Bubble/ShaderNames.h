@@ -0,0 +1,31 @@
+#ifndef _SHADER_NAMES_INCLUDE
+#define _SHADER_NAMES_INCLUDE
+
+
+#include "ShaderProgram.h"
+
+
+// Uniforms and attributes used by the game shaders. Being constexpr, their
+// hashes are computed at compile time.
+
+
+static constexpr ShaderName UNIFORM_MODELVIEW("modelview");
+static constexpr ShaderName UNIFORM_COLOR("color");
+static constexpr ShaderName UNIFORM_TEX_COORD_DISPL("texCoordDispl");
+static constexpr ShaderName UNIFORM_QUAD_RECT("quadRect");
+static constexpr ShaderName UNIFORM_MAP_ORIGIN("mapOrigin");
+static constexpr ShaderName UNIFORM_TILE_SIZE("tileSize");
+static constexpr ShaderName UNIFORM_MAP_LAYERS("mapLayers");
+static constexpr ShaderName UNIFORM_TILESHEET_SIZE("tilesheetSize");
+static constexpr ShaderName UNIFORM_TILESHEET_RECT("tilesheetRect");
+static constexpr ShaderName UNIFORM_TILE_MAP("tileMap");
+static constexpr ShaderName UNIFORM_TILESHEET("tilesheet");
+static constexpr ShaderName UNIFORM_TILE_ANIMATIONS("tileAnimations");
+
+static constexpr ShaderName ATTRIB_POSITION("position");
+static constexpr ShaderName ATTRIB_TEX_COORD("texCoord");
+static constexpr ShaderName ATTRIB_COLOR("color");
+static constexpr ShaderName ATTRIB_TILE("tile");
+
+
+#endif // _SHADER_NAMES_INCLUDE
@@ -1,11 +1,18 @@
+#include <iostream>
 #include <glm/gtc/type_ptr.hpp>
 #include "ShaderProgram.h"
+#include "GLState.h"
 
 
 ShaderProgram::ShaderProgram()
 {
 	programId = 0;
 	linked = false;
+	for(int i=0; i<SHADER_NAME_SLOTS; i++)
+	{
+		uniformSlots[i].hash = attribSlots[i].hash = 0;
+		uniformSlots[i].location = attribSlots[i].location = -1;
+	}
 }
 
 
@@ -24,36 +31,162 @@ void ShaderProgram::bindFragmentOutput(const string &outputName)
 	glBindAttribLocation(programId, 0, outputName.c_str());
 }
 
-GLint ShaderProgram::bindVertexAttribute(const string &attribName, GLint size, GLsizei stride, GLvoid *firstPointer)
+GLint ShaderProgram::bindVertexAttribute(const ShaderName &attrib, GLint size, GLsizei stride, GLvoid *firstPointer)
 {
-	GLint attribPos;
+	return bindVertexAttribute(attrib, size, GL_FLOAT, GL_FALSE, stride, firstPointer);
+}
+
+GLint ShaderProgram::bindVertexAttribute(const ShaderName &attrib, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLvoid *firstPointer)
+{
+	GLint attribPos = attributeLocation(attrib);
 
-	attribPos = glGetAttribLocation(programId, attribName.c_str());
-	glVertexAttribPointer(attribPos, size, GL_FLOAT, GL_FALSE, stride, firstPointer);
+	// The vertex array bound now remembers the pointer and the enable
+	if(attribPos != -1)
+	{
+		glVertexAttribPointer(attribPos, size, type, normalized, stride, firstPointer);
+		glEnableVertexAttribArray(attribPos);
+	}
 
 	return attribPos;
 }
 
 void ShaderProgram::link()
+{
+	startLink();
+	finishLink();
+}
+
+void ShaderProgram::startLink(bool retrievable)
+{
+	if(retrievable)
+		glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(programId);
+}
+
+void ShaderProgram::finishLink()
 {
 	GLint status;
 	char buffer[512];
 
-	glLinkProgram(programId);
 	glGetProgramiv(programId, GL_LINK_STATUS, &status);
 	linked = (status == GL_TRUE);
 	glGetProgramInfoLog(programId, 512, NULL, buffer);
 	errorLog.assign(buffer);
+	if(linked)
+		onLinked();
+}
+
+bool ShaderProgram::loadBinary(GLenum format, const void *binary, GLsizei length)
+{
+	GLint status;
+
+	if(programId == 0)
+		init();
+	glProgramBinary(programId, format, binary, length);
+	// Fails if the driver changed since the binary was saved
+	glGetProgramiv(programId, GL_LINK_STATUS, &status);
+	linked = (status == GL_TRUE);
+	errorLog.clear();
+	if(linked)
+		onLinked();
+
+	return linked;
+}
+
+bool ShaderProgram::getBinary(GLenum &format, vector<char> &binary) const
+{
+	GLint length = 0;
+
+	if(!linked)
+		return false;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0)
+		return false;
+	binary.resize(length);
+	glGetProgramBinary(programId, length, &length, &format, &binary[0]);
+	binary.resize(length);
+
+	return length > 0;
+}
+
+void ShaderProgram::onLinked()
+{
+	GLuint frameBlock = glGetUniformBlockIndex(programId, FRAME_DATA_BLOCK);
+
+	if(frameBlock != GL_INVALID_INDEX)
+		glUniformBlockBinding(programId, frameBlock, FRAME_DATA_BINDING);
+	resolveLocations();
+}
+
+// Asks the program for every active uniform and attribute once, so
+// the per-draw calls never go through glGet*Location
+
+void ShaderProgram::resolveLocations()
+{
+	GLint nUniforms, nAttribs, size;
+	GLenum type;
+	GLchar name[256];
+	GLsizei length;
+
+	for(int i=0; i<SHADER_NAME_SLOTS; i++)
+	{
+		uniformSlots[i].location = attribSlots[i].location = -1;
+		uniformSlots[i].hash = attribSlots[i].hash = 0;
+	}
+	glGetProgramiv(programId, GL_ACTIVE_UNIFORMS, &nUniforms);
+	for(GLint i=0; i<nUniforms; i++)
+	{
+		glGetActiveUniform(programId, i, sizeof(name), &length, &size, &type, name);
+		// Arrays are reported as "name[0]", they are looked up by their base name
+		if(length > 3 && string(name + length - 3) == "[0]")
+			name[length - 3] = '\0';
+		addLocation(uniformSlots, name, glGetUniformLocation(programId, name));
+	}
+	glGetProgramiv(programId, GL_ACTIVE_ATTRIBUTES, &nAttribs);
+	for(GLint i=0; i<nAttribs; i++)
+	{
+		glGetActiveAttrib(programId, i, sizeof(name), &length, &size, &type, name);
+		addLocation(attribSlots, name, glGetAttribLocation(programId, name));
+	}
+}
+
+void ShaderProgram::addLocation(LocationSlot *slots, const char *name, GLint location)
+{
+	unsigned int hash = hashShaderName(name);
+
+	// Uniforms inside blocks and built-in attributes have no location
+	if(location == -1)
+		return;
+	for(unsigned int i=0; i<SHADER_NAME_SLOTS; i++)
+	{
+		LocationSlot &slot = slots[(hash + i) & (SHADER_NAME_SLOTS - 1)];
+
+		if(slot.location == -1)
+		{
+			slot.hash = hash;
+			slot.location = location;
+			return;
+		}
+		if(slot.hash == hash)
+		{
+			cout << "Shader names with the same hash: " << name << endl;
+			return;
+		}
+	}
+	cout << "Too many shader variables, " << name << " will not be set" << endl;
 }
 
 void ShaderProgram::free()
 {
 	glDeleteProgram(programId);
+	GLState::instance().invalidate();
+	programId = 0;
+	linked = false;
 }
 
 void ShaderProgram::use()
 {
-	glUseProgram(programId);
+	GLState::instance().useProgram(programId);
 }
 
 bool ShaderProgram::isLinked()
@@ -66,33 +199,41 @@ const string &ShaderProgram::log() const
 	return errorLog;
 }
 
-void ShaderProgram::setUniform2f(const string &uniformName, float v0, float v1)
+void ShaderProgram::setUniform1i(const ShaderName &uniform, int v0)
+{
+	GLint location = uniformLocation(uniform);
+
+	if(location != -1)
+		glUniform1i(location, v0);
+}
+
+void ShaderProgram::setUniform2f(const ShaderName &uniform, float v0, float v1)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	GLint location = uniformLocation(uniform);
 
 	if(location != -1)
 		glUniform2f(location, v0, v1);
 }
 
-void ShaderProgram::setUniform3f(const string &uniformName, float v0, float v1, float v2)
+void ShaderProgram::setUniform3f(const ShaderName &uniform, float v0, float v1, float v2)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	GLint location = uniformLocation(uniform);
 
 	if(location != -1)
 		glUniform3f(location, v0, v1, v2);
 }
 
-void ShaderProgram::setUniform4f(const string &uniformName, float v0, float v1, float v2, float v3)
+void ShaderProgram::setUniform4f(const ShaderName &uniform, float v0, float v1, float v2, float v3)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	GLint location = uniformLocation(uniform);
 
 	if(location != -1)
 		glUniform4f(location, v0, v1, v2, v3);
 }
 
-void ShaderProgram::setUniformMatrix4f(const string &uniformName, glm::mat4 &mat)
+void ShaderProgram::setUniformMatrix4f(const ShaderName &uniform, const glm::mat4 &mat)
 {
-	GLint location = glGetUniformLocation(programId, uniformName.c_str());
+	GLint location = uniformLocation(uniform);
 
 	if(location != -1)
 		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
@@ -2,12 +2,40 @@
 #define _SHADER_PROGRAM_INCLUDE
 
 
+#include <vector>
 #include <GL/glew.h>
 #include <GL/gl.h>
 #include <glm/glm.hpp>
 #include "Shader.h"
 
 
+#define SHADER_NAME_SLOTS 32 // Uniforms (and attributes) a program can resolve, power of two
+
+#define FRAME_DATA_BLOCK "FrameData" // Per-frame uniform block, see FrameUniforms
+#define FRAME_DATA_BINDING 0
+
+
+// FNV-1a, usable at compile time
+
+constexpr unsigned int hashShaderName(const char *str, unsigned int hash = 2166136261u)
+{
+	return *str == '\0' ? hash : hashShaderName(str + 1, (hash ^ (unsigned char)*str) * 16777619u);
+}
+
+
+// ShaderName identifies a uniform or attribute by the hash of its name.
+// Declared constexpr (see ShaderNames.h) the hash is computed by the compiler,
+// so looking up a location is a single index into a small table.
+
+struct ShaderName
+{
+	constexpr ShaderName(const char *name) : name(name), hash(hashShaderName(name)) {}
+
+	const char *name;
+	unsigned int hash;
+};
+
+
 // Using the Shader class ShaderProgram can link a vertex and a fragment shader
 // together, bind input attributes to their corresponding vertex shader names, 
 // and bind the fragment output to a name from the fragment shader
@@ -22,25 +50,69 @@ public:
 	void init();
 	void addShader(const Shader &shader);
 	void bindFragmentOutput(const string &outputName);
-	GLint bindVertexAttribute(const string &attribName, GLint size, GLsizei stride, GLvoid *firstPointer);
+	GLint bindVertexAttribute(const ShaderName &attrib, GLint size, GLsizei stride, GLvoid *firstPointer);
+	// Same for integer vertex data, converted to float (normalized or not)
+	GLint bindVertexAttribute(const ShaderName &attrib, GLint size, GLenum type, GLboolean normalized, GLsizei stride, GLvoid *firstPointer);
+	// Linking also resolves the locations of all active uniforms and attributes
+	// and connects the FrameData block, if used, to FRAME_DATA_BINDING
 	void link();
 	void free();
 
+	// Split version of link: startLink returns without waiting for the driver,
+	// finishLink fetches the result. If retrievable, getBinary may be used later.
+	void startLink(bool retrievable = false);
+	void finishLink();
+
+	// Program binaries, as returned by glGetProgramBinary
+	bool loadBinary(GLenum format, const void *binary, GLsizei length);
+	bool getBinary(GLenum &format, vector<char> &binary) const;
+
 	void use();
 
+	// Locations resolved at link time, -1 if the program does not use the name
+	GLint uniformLocation(const ShaderName &uniform) const { return findLocation(uniformSlots, uniform.hash); }
+	GLint attributeLocation(const ShaderName &attrib) const { return findLocation(attribSlots, attrib.hash); }
+
 	// Pass uniforms to the associated shaders
-	void setUniform2f(const string &uniformName, float v0, float v1);
-	void setUniform3f(const string &uniformName, float v0, float v1, float v2);
-	void setUniform4f(const string &uniformName, float v0, float v1, float v2, float v3);
-	void setUniformMatrix4f(const string &uniformName, glm::mat4 &mat);
+	void setUniform1i(const ShaderName &uniform, int v0);
+	void setUniform2f(const ShaderName &uniform, float v0, float v1);
+	void setUniform3f(const ShaderName &uniform, float v0, float v1, float v2);
+	void setUniform4f(const ShaderName &uniform, float v0, float v1, float v2, float v3);
+	void setUniformMatrix4f(const ShaderName &uniform, const glm::mat4 &mat);
 
 	bool isLinked();
 	const string &log() const;
 
+private:
+	void onLinked();
+
+	// Open addressing on the name hash. Slots are filled at link time, so
+	// lookups almost always hit the first slot they try.
+	struct LocationSlot
+	{
+		unsigned int hash;
+		GLint location;
+	};
+
+	void resolveLocations();
+	void addLocation(LocationSlot *slots, const char *name, GLint location);
+	static GLint findLocation(const LocationSlot *slots, unsigned int hash)
+	{
+		for(unsigned int i=0; i<SHADER_NAME_SLOTS; i++)
+		{
+			const LocationSlot &slot = slots[(hash + i) & (SHADER_NAME_SLOTS - 1)];
+
+			if(slot.location == -1 || slot.hash == hash)
+				return slot.location;
+		}
+		return -1;
+	}
+
 private:
 	GLuint programId;
 	bool linked;
 	string errorLog;
+	LocationSlot uniformSlots[SHADER_NAME_SLOTS], attribSlots[SHADER_NAME_SLOTS];
 
 };
 
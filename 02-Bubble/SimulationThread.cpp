@@ -0,0 +1,71 @@
+#include <chrono>
+#include <GLFW/glfw3.h>
+#include "SimulationThread.h"
+#include "Game.h"
+#include "Profiler.h"
+
+
+SimulationThread::SimulationThread()
+{
+	running = quit = false;
+	timePerTick = 0.0;
+	maxTicks = 0;
+}
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+
+void SimulationThread::start(double ticksPerSecond, int maxTicksPerStep)
+{
+	stop();
+	timePerTick = 1.0 / ticksPerSecond;
+	maxTicks = maxTicksPerStep;
+	quit = false;
+	running = true;
+	thread = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+	quit = true;
+	if(thread.joinable())
+		thread.join();
+	running = false;
+}
+
+void SimulationThread::run()
+{
+	double simTime = glfwGetTime(), currentTime;
+	int nTicks;
+
+	PROFILE_THREAD("Simulation");
+	while(!quit)
+	{
+		/* Run every tick that is due. If the simulation falls behind by more than
+		   maxTicks, the extra time is dropped instead of trying to catch up. */
+		currentTime = glfwGetTime();
+		for(nTicks = 0; simTime + timePerTick <= currentTime && nTicks < maxTicks; nTicks++)
+		{
+			if(!Game::instance().update(float(1000.0 * timePerTick)))
+			{
+				running = false;
+				return;
+			}
+			simTime += timePerTick;
+		}
+		if(simTime + timePerTick <= currentTime)
+			simTime = currentTime;
+		if(nTicks > 0)
+			Game::instance().publishSnapshot(simTime);
+
+		/* Sleep until the next tick is due. Oversleeping a little is harmless,
+		   the renderer interpolates from the snapshot time anyway. */
+		currentTime = glfwGetTime();
+		if(simTime + timePerTick > currentTime)
+			std::this_thread::sleep_for(std::chrono::duration<double>(simTime + timePerTick - currentTime));
+	}
+	running = false;
+}
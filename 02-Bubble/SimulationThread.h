@@ -0,0 +1,41 @@
+#ifndef _SIMULATION_THREAD_INCLUDE
+#define _SIMULATION_THREAD_INCLUDE
+
+
+#include <thread>
+#include <atomic>
+
+
+// SimulationThread runs the fixed timestep updates of the game on its own
+// thread. After every batch of ticks it publishes a snapshot of the scene,
+// so the main thread can keep rendering (and waiting for vsync) at its own
+// pace without ever blocking the simulation, and vice versa.
+
+
+class SimulationThread
+{
+
+public:
+	SimulationThread();
+	~SimulationThread();
+
+	// Game::init must have been called before starting the thread
+	void start(double ticksPerSecond, int maxTicksPerStep);
+	void stop();
+
+	// False once the game asked to quit (or the thread was stopped)
+	bool isRunning() const { return running; }
+
+private:
+	void run();
+
+private:
+	std::thread thread;
+	std::atomic<bool> running, quit;
+	double timePerTick;
+	int maxTicks;
+
+};
+
+
+#endif // _SIMULATION_THREAD_INCLUDE
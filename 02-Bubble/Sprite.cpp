@@ -1,41 +1,32 @@
-#include <GL/glew.h>
-#include <GL/gl.h>
-#include <glm/gtc/matrix_transform.hpp>
 #include "Sprite.h"
 
 
-Sprite *Sprite::createSprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, Texture *spritesheet, ShaderProgram *program)
+Sprite *Sprite::createSprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, const TextureHandle &spritesheet)
 {
-	Sprite *quad = new Sprite(quadSize, sizeInSpritesheet, spritesheet, program);
+	Sprite *quad = new Sprite(quadSize, sizeInSpritesheet, spritesheet);
 
 	return quad;
 }
 
 
-Sprite::Sprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, Texture *spritesheet, ShaderProgram *program)
+Sprite::Sprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, const TextureHandle &spritesheet)
 {
-	float vertices[24] = {0.f, 0.f, 0.f, 0.f, 
-												quadSize.x, 0.f, sizeInSpritesheet.x, 0.f, 
-												quadSize.x, quadSize.y, sizeInSpritesheet.x, sizeInSpritesheet.y, 
-												0.f, 0.f, 0.f, 0.f, 
-												quadSize.x, quadSize.y, sizeInSpritesheet.x, sizeInSpritesheet.y, 
-												0.f, quadSize.y, 0.f, sizeInSpritesheet.y};
-
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	glGenBuffers(1, &vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(float), vertices, GL_STATIC_DRAW);
-	posLocation = program->bindVertexAttribute("position", 2, 4*sizeof(float), 0);
-	texCoordLocation = program->bindVertexAttribute("texCoord", 2, 4*sizeof(float), (void *)(2*sizeof(float)));
+	const Texture *sheet = AssetCache::instance().get(spritesheet);
+
+	this->quadSize = quadSize;
 	texture = spritesheet;
-	shaderProgram = program;
+	// Keyframes are given in the spritesheet, they are kept in atlas coordinates
+	this->sizeInSpritesheet = sheet != NULL ? sheet->atlasSize(sizeInSpritesheet) : sizeInSpritesheet;
+	color = glm::vec4(1.f);
 	currentAnimation = -1;
 	position = glm::vec2(0.f);
+	prevPosition = position;
 }
 
-void Sprite::update(int deltaTime)
+void Sprite::update(float deltaTime)
 {
+	// Position at the start of the tick, used to interpolate when rendering
+	prevPosition = position;
 	if(currentAnimation >= 0)
 	{
 		timeAnimation += deltaTime;
@@ -48,26 +39,20 @@ void Sprite::update(int deltaTime)
 	}
 }
 
-void Sprite::render() const
-{
-	glm::mat4 modelview = glm::translate(glm::mat4(1.0f), glm::vec3(position.x, position.y, 0.f));
-
-	if (mirrorX) {
-		// Mueve el sprite hacia la derecha antes de reflejarlo
-		modelview = glm::translate(modelview, glm::vec3(32, 0, 0));
-		modelview = glm::scale(modelview, glm::vec3(-1.0f, 1.0f, 1.0f));
-	}
-
+// Alpha is the fraction of a simulation tick elapsed since the last update.
+// The sprite is drawn between its previous and current positions.
 
-	shaderProgram->setUniformMatrix4f("modelview", modelview);
-	shaderProgram->setUniform2f("texCoordDispl", texCoordDispl.x, texCoordDispl.y);
-	glEnable(GL_TEXTURE_2D);
-	texture->use();
-	glBindVertexArray(vao);
-	glEnableVertexAttribArray(posLocation);
-	glEnableVertexAttribArray(texCoordLocation);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glDisable(GL_TEXTURE_2D);
+void Sprite::render(SpriteBatch &batch, const SpriteState &state, float alpha) const
+{
+	const Texture *sheet = AssetCache::instance().get(texture);
+	glm::vec2 renderPos = glm::mix(state.prevPosition, state.position, alpha);
+	glm::vec2 texCoord[2];
+
+	if(sheet == NULL)
+		return;
+	texCoord[0] = state.texCoordDispl;
+	texCoord[1] = state.texCoordDispl + sizeInSpritesheet;
+	batch.draw(sheet, renderPos, quadSize, texCoord, state.mirrorX, state.color);
 }
 
 bool Sprite::isMirrored() const
@@ -75,9 +60,17 @@ bool Sprite::isMirrored() const
 	return mirrorX;
 }
 
-void Sprite::free()
+SpriteState Sprite::getState() const
 {
-	glDeleteBuffers(1, &vbo);
+	SpriteState state;
+
+	state.position = position;
+	state.prevPosition = prevPosition;
+	state.texCoordDispl = texCoordDispl;
+	state.color = color;
+	state.mirrorX = mirrorX;
+
+	return state;
 }
 
 void Sprite::setNumberAnimations(int nAnimations)
@@ -95,7 +88,11 @@ void Sprite::setAnimationSpeed(int animId, int keyframesPerSec)
 void Sprite::addKeyframe(int animId, const glm::vec2 &displacement)
 {
 	if(animId < int(animations.size()))
-		animations[animId].keyframeDispl.push_back(displacement);
+	{
+		const Texture *sheet = AssetCache::instance().get(texture);
+
+		animations[animId].keyframeDispl.push_back(sheet != NULL ? sheet->atlasCoord(displacement) : displacement);
+	}
 }
 
 void Sprite::changeAnimation(int animId)
@@ -115,6 +112,13 @@ int Sprite::animation() const
 }
 
 void Sprite::setPosition(const glm::vec2 &pos)
+{
+	position = pos;
+	// Placed, not moved: nothing to interpolate from
+	prevPosition = pos;
+}
+
+void Sprite::moveTo(const glm::vec2 &pos)
 {
 	position = pos;
 }
@@ -4,28 +4,45 @@
 
 #include <vector>
 #include <glm/glm.hpp>
-#include "Texture.h"
-#include "ShaderProgram.h"
+#include "AssetCache.h"
+#include "SpriteBatch.h"
 #include "AnimKeyframes.h"
 
 
 // This class is derived from code seen earlier in TexturedQuad but it is also
-// able to manage animations stored as a spritesheet. 
+// able to manage animations stored as a spritesheet. Sprites own no OpenGL
+// resources, they are drawn through a SpriteBatch.
+
+
+// Copy of everything that changes when a sprite is updated. The renderer
+// draws from these copies so it never reads a sprite the simulation
+// thread is modifying.
+
+
+struct SpriteState
+{
+	glm::vec2 position, prevPosition;
+	glm::vec2 texCoordDispl;
+	glm::vec4 color;
+	bool mirrorX;
+};
 
 
 class Sprite
 {
 
 private:
-	Sprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, Texture *spritesheet, ShaderProgram *program);
+	Sprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, const TextureHandle &spritesheet);
 
 public:
-	// Textured quads can only be created inside an OpenGL context
-	static Sprite *createSprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, Texture *spritesheet, ShaderProgram *program);
+	// In headless mode the spritesheet may be an invalid handle, the sprite
+	// then only keeps track of its position and animation. The handle is
+	// not acquired, whoever loaded the texture keeps it.
+	static Sprite *createSprite(const glm::vec2 &quadSize, const glm::vec2 &sizeInSpritesheet, const TextureHandle &spritesheet);
 
-	void update(int deltaTime);
-	void render() const;
-	void free();
+	void update(float deltaTime);
+	// Queues the sprite as it was in state into the batch
+	void render(SpriteBatch &batch, const SpriteState &state, float alpha) const;
 
 	void setNumberAnimations(int nAnimations);
 	void setAnimationSpeed(int animId, int keyframesPerSec);
@@ -33,18 +50,24 @@ public:
 	void changeAnimation(int animId);
 	int animation() const;
 	
+	// setPosition() places the sprite (no interpolation from where it was),
+	// moveTo() is the position reached by this tick's update
 	void setPosition(const glm::vec2 &pos);
+	void moveTo(const glm::vec2 &pos);
 
 	void setMirror(bool mirror) { mirrorX = mirror; }
 	bool isMirrored() const;
 
+	// Tint multiplied with the texture, white by default
+	void setColor(const glm::vec4 &color) { this->color = color; }
+
+	SpriteState getState() const;
+
 private:
-	Texture *texture;
-	ShaderProgram *shaderProgram;
-	GLuint vao;
-	GLuint vbo;
-	GLint posLocation, texCoordLocation;
-	glm::vec2 position;
+	TextureHandle texture;
+	glm::vec2 quadSize, sizeInSpritesheet;
+	glm::vec4 color;
+	glm::vec2 position, prevPosition;
 	int currentAnimation, currentKeyframe;
 	float timeAnimation;
 	glm::vec2 texCoordDispl;
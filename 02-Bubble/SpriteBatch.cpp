@@ -0,0 +1,134 @@
+#include <cstddef>
+#include <algorithm>
+#include "SpriteBatch.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include "ShaderNames.h"
+
+
+SpriteBatch::SpriteBatch()
+{
+	program = NULL;
+	vao = vbo = 0;
+	capacity = 0;
+}
+
+
+void SpriteBatch::init(ShaderProgram &program)
+{
+	this->program = &program;
+	capacity = SPRITE_BATCH_INITIAL_QUADS;
+	quads.reserve(capacity);
+	vertices.reserve(6 * capacity);
+	glGenVertexArrays(1, &vao);
+	GLState::instance().bindVertexArray(vao);
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, 6 * capacity * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+	program.bindVertexAttribute(ATTRIB_POSITION, 2, sizeof(Vertex), (void *)offsetof(Vertex, position));
+	program.bindVertexAttribute(ATTRIB_TEX_COORD, 2, sizeof(Vertex), (void *)offsetof(Vertex, texCoord));
+	program.bindVertexAttribute(ATTRIB_COLOR, 4, sizeof(Vertex), (void *)offsetof(Vertex, color));
+}
+
+void SpriteBatch::free()
+{
+	glDeleteBuffers(1, &vbo);
+	glDeleteVertexArrays(1, &vao);
+	GLState::instance().invalidate();
+	vbo = vao = 0;
+}
+
+void SpriteBatch::begin()
+{
+	// clear() keeps the capacity, so a steady frame never allocates
+	quads.clear();
+	textures.clear();
+}
+
+void SpriteBatch::draw(const Texture *texture, const glm::vec2 &position, const glm::vec2 &size, const glm::vec2 texCoord[2], bool mirrorX, const glm::vec4 &color)
+{
+	Quad quad;
+	unsigned int rank;
+
+	// Few textures per frame, a linear search is enough. Views of the same
+	// atlas page are the same texture.
+	for(rank=0; rank<textures.size(); rank++)
+		if(textures[rank]->id() == texture->id())
+			break;
+	if(rank == textures.size())
+		textures.push_back(texture);
+	quad.texture = texture;
+	quad.rank = rank;
+	quad.order = (unsigned int)quads.size();
+	quad.position = position;
+	quad.size = size;
+	quad.texCoord[0] = texCoord[0];
+	quad.texCoord[1] = texCoord[1];
+	if(mirrorX)
+		swap(quad.texCoord[0].x, quad.texCoord[1].x);
+	quad.color = color;
+	quads.push_back(quad);
+}
+
+void SpriteBatch::end()
+{
+	PROFILE_SCOPE("SpriteBatch::end");
+	Vertex corners[4];
+	unsigned int first;
+
+	if(quads.empty())
+		return;
+	sort(quads.begin(), quads.end(), quadOrder);
+
+	vertices.clear();
+	for(unsigned int i=0; i<quads.size(); i++)
+	{
+		const Quad &quad = quads[i];
+
+		corners[0].position = quad.position;
+		corners[0].texCoord = quad.texCoord[0];
+		corners[1].position = glm::vec2(quad.position.x + quad.size.x, quad.position.y);
+		corners[1].texCoord = glm::vec2(quad.texCoord[1].x, quad.texCoord[0].y);
+		corners[2].position = quad.position + quad.size;
+		corners[2].texCoord = quad.texCoord[1];
+		corners[3].position = glm::vec2(quad.position.x, quad.position.y + quad.size.y);
+		corners[3].texCoord = glm::vec2(quad.texCoord[0].x, quad.texCoord[1].y);
+		for(int c=0; c<4; c++)
+			corners[c].color = quad.color;
+		// Same triangles as the tile map: 0-1-2 and 0-2-3
+		vertices.push_back(corners[0]);
+		vertices.push_back(corners[1]);
+		vertices.push_back(corners[2]);
+		vertices.push_back(corners[0]);
+		vertices.push_back(corners[2]);
+		vertices.push_back(corners[3]);
+	}
+
+	GLState::instance().bindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	while(capacity < int(quads.size()))
+		capacity *= 2;
+	// Orphan the previous contents so the driver does not wait for the GPU
+	glBufferData(GL_ARRAY_BUFFER, 6 * capacity * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(Vertex), &vertices[0]);
+
+	program->use();
+	first = 0;
+	for(unsigned int i=1; i<=quads.size(); i++)
+	{
+		if(i == quads.size() || quads[i].rank != quads[first].rank)
+		{
+			quads[first].texture->use();
+			glDrawArrays(GL_TRIANGLES, 6 * first, 6 * (i - first));
+			first = i;
+		}
+	}
+}
+
+
+bool SpriteBatch::quadOrder(const Quad &a, const Quad &b)
+{
+	if(a.rank != b.rank)
+		return a.rank < b.rank;
+	return a.order < b.order;
+}
@@ -0,0 +1,72 @@
+#ifndef _SPRITE_BATCH_INCLUDE
+#define _SPRITE_BATCH_INCLUDE
+
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Texture.h"
+#include "ShaderProgram.h"
+
+
+#define SPRITE_BATCH_INITIAL_QUADS 256 // The buffer grows if a frame needs more
+
+
+using namespace std;
+
+
+// SpriteBatch draws every sprite of a frame with one draw call per texture.
+// Quads are queued between begin() and end() with positions already in
+// world space. end() groups them by texture, keeping the queue order within
+// a texture and between textures as far as possible, writes them all to a streaming vertex buffer and draws each
+// run of quads that share a texture.
+
+
+class SpriteBatch
+{
+
+public:
+	SpriteBatch();
+
+	// These methods should be called with an active OpenGL context
+	void init(ShaderProgram &program);
+	void free();
+
+	void begin();
+	// texCoord[0] and texCoord[1] are the atlas corners of the quad. Mirrored
+	// quads are flipped horizontally inside their own rectangle.
+	void draw(const Texture *texture, const glm::vec2 &position, const glm::vec2 &size, const glm::vec2 texCoord[2], bool mirrorX, const glm::vec4 &color);
+	void end();
+
+	int quadCount() const { return int(quads.size()); }
+
+private:
+	struct Quad
+	{
+		const Texture *texture;
+		unsigned int rank, order;
+		glm::vec2 position, size;
+		glm::vec2 texCoord[2];
+		glm::vec4 color;
+	};
+
+	struct Vertex
+	{
+		glm::vec2 position;
+		glm::vec2 texCoord;
+		glm::vec4 color;
+	};
+
+	static bool quadOrder(const Quad &a, const Quad &b);
+
+private:
+	ShaderProgram *program;
+	GLuint vao, vbo;
+	int capacity;
+	vector<Quad> quads;
+	vector<const Texture *> textures; // In the order they first appear, which is the order they are drawn
+	vector<Vertex> vertices;
+
+};
+
+
+#endif // _SPRITE_BATCH_INCLUDE
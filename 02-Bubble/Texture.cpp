@@ -1,5 +1,8 @@
-#include <SOIL.h>
 #include "Texture.h"
+#include "TextureAtlas.h"
+#include "ImageFile.h"
+#include "Profiler.h"
+#include "GLState.h"
 
 
 using namespace std;
@@ -11,45 +14,87 @@ Texture::Texture()
 	wrapT = GL_REPEAT;
 	minFilter = GL_NEAREST;
 	magFilter = GL_NEAREST;
+	texId = 0;
+	atlasOffset = glm::vec2(0.f);
+	atlasScale = glm::vec2(1.f);
+	bAtlasRegion = false;
+	sampler = 0;
+	bParamsDirty = true;
 }
 
 
 bool Texture::loadFromFile(const string &filename, PixelFormat format)
 {
-	unsigned char *image = NULL;
+	PROFILE_SCOPE("Texture::loadFromFile");
+	ImageFile image;
 	
+	// Images in the atlas are already uploaded
+	if(TextureAtlas::instance().find(filename, *this))
+		return true;
+	// Baked images are uploaded straight from the mapped file
+	if(!image.load(filename, format))
+		return false;
+	loadFromBuffer(image.pixels(), image.size().x, image.size().y, format);
+	
+	return true;
+}
+
+void Texture::loadFromBuffer(const unsigned char *buffer, int width, int height, PixelFormat format)
+{
+	widthTex = width;
+	heightTex = height;
+	glGenTextures(1, &texId);
+	GLState::instance().bindTextureForUpdate(0, texId);
 	switch(format)
 	{
 	case TEXTURE_PIXEL_FORMAT_RGB:
-		image = SOIL_load_image(filename.c_str(), &widthTex, &heightTex, 0, SOIL_LOAD_RGB);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, buffer);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 		break;
 	case TEXTURE_PIXEL_FORMAT_RGBA:
-		image = SOIL_load_image(filename.c_str(), &widthTex, &heightTex, 0, SOIL_LOAD_RGBA);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, buffer);
 		break;
 	}
-	if(image == NULL)
-		return false;
-	glGenTextures(1, &texId);
-	glBindTexture(GL_TEXTURE_2D, texId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void Texture::allocate(int width, int height, PixelFormat format)
+{
+	loadFromBuffer(NULL, width, height, format);
+}
+
+void Texture::uploadRows(int y, int rows, PixelFormat format, const void *pixels)
+{
+	GLState::instance().bindTextureForUpdate(0, texId);
 	switch(format)
 	{
 	case TEXTURE_PIXEL_FORMAT_RGB:
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, widthTex, heightTex, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, widthTex, rows, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 		break;
 	case TEXTURE_PIXEL_FORMAT_RGBA:
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, widthTex, heightTex, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, widthTex, rows, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 		break;
 	}
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);  // Establece el filtro para la reduccin de la textura (minificacin)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	
-	return true;
+}
+
+void Texture::setAtlasRegion(const Texture &page, const glm::ivec2 &position, const glm::ivec2 &size)
+{
+	texId = page.texId;
+	bAtlasRegion = true;
+	widthTex = size.x;
+	heightTex = size.y;
+	atlasOffset = glm::vec2(position) / glm::vec2(float(page.widthTex), float(page.heightTex));
+	atlasScale = glm::vec2(size) / glm::vec2(float(page.widthTex), float(page.heightTex));
 }
 
 void Texture::loadFromGlyphBuffer(unsigned char *buffer, int width, int height)
 {
 	glGenTextures(1, &texId);
-	glBindTexture(GL_TEXTURE_2D, texId);
+	GLState::instance().bindTextureForUpdate(0, texId);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, buffer);
 	glGenerateMipmap(GL_TEXTURE_2D);
@@ -59,7 +104,7 @@ void Texture::loadFromGlyphBuffer(unsigned char *buffer, int width, int height)
 void Texture::createEmptyTexture(int width, int height)
 {
 	glGenTextures(1, &texId);
-	glBindTexture(GL_TEXTURE_2D, texId);
+	GLState::instance().bindTextureForUpdate(0, texId);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, 0);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -67,7 +112,7 @@ void Texture::createEmptyTexture(int width, int height)
 
 void Texture::loadSubtextureFromGlyphBuffer(unsigned char *buffer, int x, int y, int width, int height)
 {
-	glBindTexture(GL_TEXTURE_2D, texId);
+	GLState::instance().bindTextureForUpdate(0, texId);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RED, GL_UNSIGNED_BYTE, buffer);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -75,7 +120,7 @@ void Texture::loadSubtextureFromGlyphBuffer(unsigned char *buffer, int x, int y,
 
 void Texture::generateMipmap()
 {
-	glBindTexture(GL_TEXTURE_2D, texId);
+	GLState::instance().bindTextureForUpdate(0, texId);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	glGenerateMipmap(GL_TEXTURE_2D);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -84,31 +129,60 @@ void Texture::generateMipmap()
 void Texture::setWrapS(GLint value)
 {
 	wrapS = value;
+	bParamsDirty = true;
 }
 
 void Texture::setWrapT(GLint value)
 {
 	wrapT = value;
+	bParamsDirty = true;
 }
 
 void Texture::setMinFilter(GLint value)
 {
 	minFilter = value;
+	bParamsDirty = true;
 }
 
 void Texture::setMagFilter(GLint value)
 {
 	magFilter = value;
+	bParamsDirty = true;
 }
 
+// Wrap and filter modes live in a shared sampler object, so binding a
+// texture is a single call (none if it is already bound). Without sampler
+// objects the parameters are set on the texture, only when they change.
+
 void Texture::use() const
 {
-	glEnable(GL_TEXTURE_2D);
-	glBindTexture(GL_TEXTURE_2D, texId);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-}
+	GLState &state = GLState::instance();
 
+	state.bindTexture(0, texId);
+	if(bParamsDirty)
+	{
+		sampler = state.sampler(wrapS, wrapT, minFilter, magFilter);
+		if(sampler == 0)
+		{
+			state.bindTextureForUpdate(0, texId);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+		}
+		bParamsDirty = false;
+	}
+	if(sampler != 0)
+		state.bindSampler(0, sampler);
+}
 
+void Texture::free()
+{
+	if(!bAtlasRegion)
+	{
+		glDeleteTextures(1, &texId);
+		GLState::instance().invalidate();
+	}
+	texId = 0;
+	bAtlasRegion = false;
+}
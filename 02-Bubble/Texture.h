@@ -4,6 +4,7 @@
 
 #include <string>
 #include <GL/glew.h>
+#include <glm/glm.hpp>
 
 
 using namespace std;
@@ -13,7 +14,10 @@ enum PixelFormat {TEXTURE_PIXEL_FORMAT_RGB, TEXTURE_PIXEL_FORMAT_RGBA};
 
 
 // The texture class loads images an passes them to OpenGL
-// storing the returned id so that it may be applied to any drawn primitives
+// storing the returned id so that it may be applied to any drawn primitives.
+// Images packed by the TextureAtlas are instead views of an atlas page:
+// texture coordinates of the image go through atlasCoord() and atlasSize()
+// to find it inside the page.
 
 
 class Texture
@@ -23,6 +27,11 @@ public:
 	Texture();
 
 	bool loadFromFile(const string &filename, PixelFormat format);
+	void loadFromBuffer(const unsigned char *buffer, int width, int height, PixelFormat format);
+	// Creates the texture without contents, uploadRows() fills it a few rows
+	// at a time (pixels may be an offset into a bound pixel buffer)
+	void allocate(int width, int height, PixelFormat format);
+	void uploadRows(int y, int rows, PixelFormat format, const void *pixels);
 	void loadFromGlyphBuffer(unsigned char *buffer, int width, int height);
 
 	void createEmptyTexture(int width, int height);
@@ -35,14 +44,26 @@ public:
 	void setMagFilter(GLint value);
 	
 	void use() const;
+	// Atlas regions leave the page alone
+	void free();
 	
 	int width() const { return widthTex; }
 	int height() const { return heightTex; }
+	GLuint id() const { return texId; }
+
+	// Makes this texture the rectangle of page at position (in pixels)
+	void setAtlasRegion(const Texture &page, const glm::ivec2 &position, const glm::ivec2 &size);
+	glm::vec2 atlasCoord(const glm::vec2 &texCoord) const { return atlasOffset + texCoord * atlasScale; }
+	glm::vec2 atlasSize(const glm::vec2 &size) const { return size * atlasScale; }
 
 private:
 	int widthTex, heightTex;
 	GLuint texId;
+	glm::vec2 atlasOffset, atlasScale;
+	bool bAtlasRegion;
 	GLint wrapS, wrapT, minFilter, magFilter;
+	mutable GLuint sampler;
+	mutable bool bParamsDirty;
 
 };
 
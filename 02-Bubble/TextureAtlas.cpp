@@ -0,0 +1,232 @@
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include "TextureAtlas.h"
+#include "ImageFile.h"
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+void TextureAtlas::add(const string &filename)
+{
+	Image image;
+
+	image.filename = filename;
+	image.pixels = NULL;
+	image.size = glm::ivec2(0);
+	image.page = -1;
+	image.position = glm::ivec2(0);
+	images.push_back(image);
+}
+
+bool TextureAtlas::build()
+{
+	PROFILE_SCOPE("TextureAtlas::build");
+	vector<ImageFile> files(images.size());
+	vector<Image *> order;
+	GLint maxSize;
+	int area, side;
+	bool bAllPacked = true;
+
+	area = side = 0;
+	for(unsigned int i=0; i<images.size(); i++)
+	{
+		Image &image = images[i];
+
+		if(!files[i].load(image.filename, TEXTURE_PIXEL_FORMAT_RGBA))
+		{
+			cout << "Cannot load " << image.filename << " into the atlas" << endl;
+			bAllPacked = false;
+			continue;
+		}
+		image.pixels = files[i].pixels();
+		image.size = files[i].size();
+		area += (image.size.x + 2 * TEXTURE_ATLAS_PADDING) * (image.size.y + 2 * TEXTURE_ATLAS_PADDING);
+		side = max(side, max(image.size.x, image.size.y) + 2 * TEXTURE_ATLAS_PADDING);
+		order.push_back(&image);
+	}
+
+	// Smallest page that could hold every image, more pages are added if
+	// the packing leaves too much space unused
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	pageSize = TEXTURE_ATLAS_MIN_PAGE_SIZE;
+	while(pageSize < maxSize && (pageSize * pageSize < area || pageSize < side))
+		pageSize *= 2;
+
+	// Tallest images first keep the skyline flat
+	sort(order.begin(), order.end(), imageOrder);
+	for(unsigned int i=0; i<order.size(); i++)
+	{
+		Image &image = *order[i];
+		glm::ivec2 paddedSize = image.size + 2 * TEXTURE_ATLAS_PADDING;
+		glm::ivec2 position;
+		unsigned int page;
+
+		if(paddedSize.x > pageSize || paddedSize.y > pageSize)
+		{
+			// Still loaded as a texture of its own
+			cout << image.filename << " does not fit in an atlas page" << endl;
+			bAllPacked = false;
+			continue;
+		}
+		for(page=0; page<pages.size(); page++)
+			if(pack(pages[page], paddedSize, position))
+				break;
+		if(page == pages.size())
+		{
+			SkylineNode bottom = { 0, 0, pageSize };
+
+			pages.push_back(Page());
+			pages.back().skyline.push_back(bottom);
+			pages.back().pixels.resize(4 * pageSize * pageSize, 0);
+			pack(pages.back(), paddedSize, position);
+		}
+		image.page = int(page);
+		image.position = position + TEXTURE_ATLAS_PADDING;
+		copyImage(pages[page], image);
+	}
+
+	for(unsigned int i=0; i<images.size(); i++)
+	{
+		files[i].close();
+		images[i].pixels = NULL;
+	}
+	for(unsigned int page=0; page<pages.size(); page++)
+	{
+		Texture &texture = pages[page].texture;
+
+		texture.loadFromBuffer(&pages[page].pixels[0], pageSize, pageSize, TEXTURE_PIXEL_FORMAT_RGBA);
+		texture.setWrapS(GL_CLAMP_TO_EDGE);
+		texture.setWrapT(GL_CLAMP_TO_EDGE);
+		texture.setMinFilter(GL_NEAREST);
+		texture.setMagFilter(GL_NEAREST);
+		// The texture keeps its own copy
+		vector<unsigned char>().swap(pages[page].pixels);
+	}
+
+	return bAllPacked;
+}
+
+bool TextureAtlas::find(const string &filename, Texture &texture) const
+{
+	for(unsigned int i=0; i<images.size(); i++)
+	{
+		if(images[i].page >= 0 && images[i].filename == filename)
+		{
+			texture.setAtlasRegion(pages[images[i].page].texture, images[i].position, images[i].size);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool TextureAtlas::imageOrder(const Image *a, const Image *b)
+{
+	if(a->size.y != b->size.y)
+		return a->size.y > b->size.y;
+	return a->size.x > b->size.x;
+}
+
+// Bottom-left rule: the image goes where its top ends lowest, on the
+// narrowest segment if there is a tie
+
+bool TextureAtlas::pack(Page &page, const glm::ivec2 &size, glm::ivec2 &position)
+{
+	vector<SkylineNode> &skyline = page.skyline;
+	int best, bestY, bestWidth, y;
+	SkylineNode node;
+
+	best = -1;
+	bestY = bestWidth = pageSize;
+	for(unsigned int i=0; i<skyline.size(); i++)
+	{
+		if(fits(page, i, size, y) && (y < bestY || (y == bestY && skyline[i].width < bestWidth)))
+		{
+			best = i;
+			bestY = y;
+			bestWidth = skyline[i].width;
+		}
+	}
+	if(best < 0)
+		return false;
+	position = glm::ivec2(skyline[best].x, bestY);
+
+	// The image raises the skyline over its width, the segments it
+	// covers shrink or disappear
+	node.x = position.x;
+	node.y = bestY + size.y;
+	node.width = size.x;
+	skyline.insert(skyline.begin() + best, node);
+	for(unsigned int i=best+1; i<skyline.size(); )
+	{
+		int overlap = node.x + node.width - skyline[i].x;
+
+		if(overlap <= 0)
+			break;
+		if(overlap >= skyline[i].width)
+			skyline.erase(skyline.begin() + i);
+		else
+		{
+			skyline[i].x += overlap;
+			skyline[i].width -= overlap;
+			break;
+		}
+	}
+	for(unsigned int i=0; i+1<skyline.size(); )
+	{
+		if(skyline[i].y == skyline[i + 1].y)
+		{
+			skyline[i].width += skyline[i + 1].width;
+			skyline.erase(skyline.begin() + i + 1);
+		}
+		else
+			i++;
+	}
+
+	return true;
+}
+
+// An image placed at the start of node rests on the highest segment
+// below it
+
+bool TextureAtlas::fits(const Page &page, int node, const glm::ivec2 &size, int &y) const
+{
+	const vector<SkylineNode> &skyline = page.skyline;
+	int widthLeft = size.x;
+
+	if(skyline[node].x + size.x > pageSize)
+		return false;
+	y = skyline[node].y;
+	for(int i=node; widthLeft>0; i++)
+	{
+		y = max(y, skyline[i].y);
+		if(y + size.y > pageSize)
+			return false;
+		widthLeft -= skyline[i].width;
+	}
+
+	return true;
+}
+
+void TextureAtlas::copyImage(Page &page, const Image &image)
+{
+	const int padding = TEXTURE_ATLAS_PADDING;
+
+	for(int j=-padding; j<image.size.y + padding; j++)
+	{
+		int srcRow = glm::clamp(j, 0, image.size.y - 1);
+		unsigned char *dst = &page.pixels[4 * ((image.position.y + j) * pageSize + image.position.x - padding)];
+		const unsigned char *src = &image.pixels[4 * srcRow * image.size.x];
+
+		// Left padding, the row itself and right padding
+		for(int i=0; i<padding; i++, dst+=4)
+			memcpy(dst, src, 4);
+		memcpy(dst, src, 4 * image.size.x);
+		dst += 4 * image.size.x;
+		for(int i=0; i<padding; i++, dst+=4)
+			memcpy(dst, src + 4 * (image.size.x - 1), 4);
+	}
+}
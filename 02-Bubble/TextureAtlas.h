@@ -0,0 +1,87 @@
+#ifndef _TEXTURE_ATLAS_INCLUDE
+#define _TEXTURE_ATLAS_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Texture.h"
+
+
+#define TEXTURE_ATLAS_MIN_PAGE_SIZE 256 // Pages are square, a power of two at least this big
+#define TEXTURE_ATLAS_PADDING 2 // Border around every image, filled with its edge pixels
+
+
+using namespace std;
+
+
+// TextureAtlas packs the images added before build() into one or a few
+// pages with a skyline packer. From then on, a Texture loaded from one of
+// these files is a view of its page (see Texture::loadFromFile) and maps
+// its texture coordinates into it, so sprites and tiles that come from
+// different images are drawn with the same texture bound.
+// The padding repeats the edge pixels of every image, so filtering never
+// reads a neighbour.
+
+
+class TextureAtlas
+{
+
+private:
+	TextureAtlas() {}
+
+public:
+	static TextureAtlas &instance()
+	{
+		static TextureAtlas A;
+
+		return A;
+	}
+
+	// Images are RGBA, files must be named as they will be loaded
+	void add(const string &filename);
+	// Should be called with an active OpenGL context
+	bool build();
+
+	// Makes texture a view of the region of filename, false if it was not packed
+	bool find(const string &filename, Texture &texture) const;
+
+	int pageCount() const { return int(pages.size()); }
+
+private:
+	struct Image
+	{
+		string filename;
+		const unsigned char *pixels;
+		glm::ivec2 size;
+		int page;
+		glm::ivec2 position;  // Top left corner of the image, inside the padding
+	};
+
+	// Segment of the top of the packed area, spanning [x, x + width)
+	struct SkylineNode
+	{
+		int x, y, width;
+	};
+
+	struct Page
+	{
+		vector<SkylineNode> skyline;
+		vector<unsigned char> pixels;
+		Texture texture;
+	};
+
+	static bool imageOrder(const Image *a, const Image *b);
+	bool pack(Page &page, const glm::ivec2 &size, glm::ivec2 &position);
+	bool fits(const Page &page, int node, const glm::ivec2 &size, int &y) const;
+	void copyImage(Page &page, const Image &image);
+
+private:
+	vector<Image> images;
+	vector<Page> pages;
+	int pageSize;
+
+};
+
+
+#endif // _TEXTURE_ATLAS_INCLUDE
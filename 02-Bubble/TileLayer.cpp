@@ -0,0 +1,78 @@
+#include <fstream>
+#include <sstream>
+#include "TileLayer.h"
+#include "Profiler.h"
+
+
+using namespace std;
+
+
+bool TileLayer::loadFromFile(const string &filename)
+{
+	PROFILE_SCOPE("TileLayer::loadFromFile");
+	ifstream fin(filename.c_str());
+	if (!fin.is_open())
+		return false;
+
+	string line;
+	stringstream sstream;
+
+	// Comprobar encabezado
+	getline(fin, line);
+	if (line.compare(0, 7, "TILEMAP") != 0)
+		return false;
+
+	// Leer tamao del mapa
+	getline(fin, line);
+	sstream.clear();
+	sstream.str(line);
+	sstream >> mapSize.x >> mapSize.y;
+
+	// Leer tileSize y blockSize
+	getline(fin, line);
+	sstream.clear();
+	sstream.str(line);
+	sstream >> tileSize >> blockSize;
+
+	// Leer nombre del fichero de tilesheet
+	getline(fin, line);
+	sstream.clear();
+	sstream.str(line);
+	sstream >> tilesheetFile;
+
+	// Leer tamao del tilesheet
+	getline(fin, line);
+	sstream.clear();
+	sstream.str(line);
+	sstream >> tilesheetSize.x >> tilesheetSize.y;
+
+	// Reservar memoria para el mapa
+	tiles.resize(mapSize.x * mapSize.y);
+
+	// Leer el mapa lnea por lnea, esperando valores separados por comas.
+	for (int j = 0; j < mapSize.y; j++)
+	{
+		getline(fin, line); // Leer una lnea completa del mapa.
+		stringstream lineStream(line);
+		for (int i = 0; i < mapSize.x; i++)
+		{
+			int value;
+			lineStream >> value;
+			// Si el valor es -1, se asigna tile vaco (0).
+			if (value == -1)
+				tiles[j * mapSize.x + i] = 0;
+			else
+				tiles[j * mapSize.x + i] = value;
+			// Se ignora la coma entre nmeros, excepto tras el ltimo valor de la lnea.
+
+			if (i < mapSize.x - 1)
+			{
+				if (lineStream.peek() == ',')
+					lineStream.ignore();
+			}
+		}
+	}
+
+	fin.close();
+	return true;
+}
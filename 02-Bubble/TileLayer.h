@@ -0,0 +1,30 @@
+#ifndef _TILE_LAYER_INCLUDE
+#define _TILE_LAYER_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+
+using namespace std;
+
+
+// TileLayer is the content of a tile map file (see level01.txt): map and
+// tile sizes, the tilesheet it uses and the tile of every cell, with 0 for
+// empty cells. It is what the AssetCache keeps for level files, TileMap
+// builds its layers from it.
+
+
+struct TileLayer
+{
+	bool loadFromFile(const string &filename);
+
+	glm::ivec2 mapSize, tilesheetSize;
+	int tileSize, blockSize;
+	string tilesheetFile;
+	vector<int> tiles;
+};
+
+
+#endif // _TILE_LAYER_INCLUDE
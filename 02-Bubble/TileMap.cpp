@@ -2,7 +2,16 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstddef>
+#include <cstring>
 #include "TileMap.h"
+#include "Profiler.h"
+#include "ShaderNames.h"
+#include "GLState.h"
+#include "AssetCache.h"
 
 
 using namespace std;
@@ -16,157 +25,747 @@ TileMap *TileMap::createTileMap(const string &levelFile, const glm::vec2 &minCoo
 }
 
 
+TileMap *TileMap::createTileMap(const string &levelFile)
+{
+	TileMap *map = new TileMap(levelFile);
+	
+	return map;
+}
+
+
 TileMap::TileMap(const string &levelFile, const glm::vec2 &minCoords, ShaderProgram &program)
 {
-	loadLevel(levelFile);
+	lookupVao = lookupTexture = 0;
+	animationTexture = 0;
+	lookupProgram = NULL;
+	renderMode = TILEMAP_RENDER_GEOMETRY;
+	bGraphics = true;
+	loadLevel(levelFile, true);
 	prepareArrays(minCoords, program);
 }
 
+TileMap::TileMap(const string &levelFile)
+{
+	vao = vbo = ibo = 0;
+	lookupVao = lookupTexture = 0;
+	animationTexture = 0;
+	geometryProgram = lookupProgram = NULL;
+	renderMode = TILEMAP_RENDER_GEOMETRY;
+	nQuads = 0;
+	nChunks = glm::ivec2(0);
+	bGraphics = false;
+	loadLevel(levelFile, false);
+}
+
 TileMap::~TileMap()
 {
+	AssetCache &assets = AssetCache::instance();
+
 	if(map != NULL)
-		delete map;
+		delete[] map;
+	assets.release(tilesheet);
+	for(unsigned int i=0; i<layers.size(); i++)
+		assets.release(layers[i]);
 }
 
 
-void TileMap::render() const
+void TileMap::render(const glm::vec2 &viewMin, const glm::vec2 &viewMax) const
 {
-	glEnable(GL_TEXTURE_2D);
-	tilesheet.use();
-	glBindVertexArray(vao);
-	glEnableVertexAttribArray(posLocation);
-	glEnableVertexAttribArray(texCoordLocation);
-	glDrawArrays(GL_TRIANGLES, 0, 6 * nTiles);
-	glDisable(GL_TEXTURE_2D);
+	PROFILE_SCOPE("TileMap::render");
+	if(renderMode == TILEMAP_RENDER_LOOKUP && lookupProgram != NULL)
+		renderLookup(viewMin, viewMax);
+	else
+		renderGeometry(viewMin, viewMax);
+}
+
+void TileMap::renderGeometry(const glm::vec2 &viewMin, const glm::vec2 &viewMax) const
+{
+	glm::ivec2 first, last;
+
+	// Range of chunks holding the visible tiles. A tile i covers
+	// [i * tileSize, i * tileSize + blockSize), blocks may overlap.
+	first = glm::ivec2(glm::floor((viewMin - minCoords - float(blockSize)) / float(tileSize))) + 1;
+	last = glm::ivec2(glm::ceil((viewMax - minCoords) / float(tileSize))) - 1;
+	if(last.x < 0 || last.y < 0)
+		return;
+	first = glm::max(first, glm::ivec2(0)) / TILEMAP_CHUNK_SIZE;
+	last = glm::min(last / TILEMAP_CHUNK_SIZE, nChunks - 1);
+
+	// Chunks next to each other in a row are also contiguous in the VBO,
+	// so they are merged into a single range
+	drawBase.clear();
+	drawCount.clear();
+	for(int cj=first.y; cj<=last.y; cj++)
+	{
+		for(int ci=first.x; ci<=last.x; ci++)
+		{
+			int chunk = cj * nChunks.x + ci;
+			int quads = drawCount.empty() ? 0 : drawCount.back() / 6;
+
+			if(chunkTiles[chunk] == 0)
+				continue;
+			if(!drawCount.empty() && drawBase.back() + 4 * quads == chunkFirst[chunk] && quads + chunkQuads[chunk] <= nIndexedQuads)
+				drawCount.back() += 6 * chunkQuads[chunk];
+			else
+			{
+				drawBase.push_back(chunkFirst[chunk]);
+				drawCount.push_back(6 * chunkQuads[chunk]);
+			}
+		}
+	}
+	if(drawCount.empty())
+		return;
+	// Every range starts at the beginning of the shared index buffer
+	drawIndices.resize(drawCount.size(), NULL);
+	geometryProgram->use();
+	useTilesheet(*geometryProgram);
+	useAnimations();
+	GLState::instance().bindVertexArray(vao);
+	glMultiDrawElementsBaseVertex(GL_TRIANGLES, &drawCount[0], GL_UNSIGNED_SHORT, &drawIndices[0], GLsizei(drawCount.size()), &drawBase[0]);
+}
+
+// The quad only covers the visible part of the map, its pixels find their
+// tile with a texel fetch and then sample the tilesheet
+
+void TileMap::renderLookup(const glm::vec2 &viewMin, const glm::vec2 &viewMax) const
+{
+	GLState &state = GLState::instance();
+	glm::vec2 quadMin, quadMax;
+	GLuint sampler;
+
+	quadMin = glm::max(viewMin, minCoords);
+	quadMax = glm::min(viewMax, minCoords + glm::vec2(mapSize * tileSize));
+	if(quadMin.x >= quadMax.x || quadMin.y >= quadMax.y)
+		return;
+	lookupProgram->use();
+	lookupProgram->setUniform4f(UNIFORM_QUAD_RECT, quadMin.x, quadMin.y, quadMax.x, quadMax.y);
+	lookupProgram->setUniform2f(UNIFORM_MAP_ORIGIN, minCoords.x, minCoords.y);
+	lookupProgram->setUniform1i(UNIFORM_TILE_SIZE, tileSize);
+	lookupProgram->setUniform1i(UNIFORM_MAP_LAYERS, nLayers);
+	useTilesheet(*lookupProgram);
+	useAnimations();
+	state.bindTexture(TILEMAP_LOOKUP_UNIT, lookupTexture);
+	// Integer textures cannot be filtered
+	sampler = state.sampler(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+	if(sampler != 0)
+		state.bindSampler(TILEMAP_LOOKUP_UNIT, sampler);
+	state.bindVertexArray(lookupVao);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 }
 
 void TileMap::free()
 {
 	glDeleteBuffers(1, &vbo);
+	glDeleteBuffers(1, &ibo);
+	glDeleteVertexArrays(1, &vao);
+	glDeleteTextures(1, &lookupTexture);
+	glDeleteVertexArrays(1, &lookupVao);
+	glDeleteTextures(1, &animationTexture);
+	GLState::instance().invalidate();
+	vbo = ibo = vao = 0;
+	lookupTexture = lookupVao = 0;
+	animationTexture = 0;
+	lookupProgram = NULL;
+}
+
+void TileMap::preloadLevel(const string &levelFile, vector<LayerHandle> &handles)
+{
+	vector<string> layerFiles;
+	string animationFile;
+	int collisionLayer;
+
+	if (!readLevel(levelFile, layerFiles, collisionLayer, animationFile))
+		return;
+	for (unsigned int layer = 0; layer < layerFiles.size(); layer++)
+		handles.push_back(AssetCache::instance().loadLayerAsync(layerFiles[layer]));
 }
 
-bool TileMap::loadLevel(const string& levelFile)
+bool TileMap::readLevel(const string& levelFile, vector<string> &layerFiles, int &collisionLayer, string &animationFile)
 {
 	ifstream fin(levelFile.c_str());
 	if (!fin.is_open())
 		return false;
 
-	string line, tilesheetFile;
+	string line, layerFile;
 	stringstream sstream;
+	int nLayers;
 
-	// Comprobar encabezado
 	getline(fin, line);
-	if (line.compare(0, 7, "TILEMAP") != 0)
+	if (line.compare(0, 7, "TILEMAP") == 0)
+	{
+		// Un fichero de tile map es un nivel de una sola capa
+		nLayers = 1;
+		collisionLayer = 0;
+		layerFiles.push_back(levelFile);
+	}
+	else if (line.compare(0, 5, "LEVEL") == 0)
+	{
+		// Leer nmero de capas
+		getline(fin, line);
+		sstream.clear();
+		sstream.str(line);
+		sstream >> nLayers;
+
+		// Leer los ficheros de las capas, de la del fondo a la del frente
+		for (int layer = 0; layer < nLayers; layer++)
+		{
+			getline(fin, line);
+			sstream.clear();
+			sstream.str(line);
+			sstream >> layerFile;
+			layerFiles.push_back(layerFile);
+		}
+
+		// Leer la capa con la que se comprueban las colisiones
+		getline(fin, line);
+		sstream.clear();
+		sstream.str(line);
+		sstream >> collisionLayer;
+
+		// Leer el fichero de tiles animados, si lo hay
+		if (getline(fin, line))
+		{
+			sstream.clear();
+			sstream.str(line);
+			sstream >> animationFile;
+			if (animationFile.compare(0, 2, "--") == 0)
+				animationFile.clear();
+		}
+	}
+	else
 		return false;
+	fin.close();
 
-	// Leer tamao del mapa
-	getline(fin, line);
-	sstream.clear();
-	sstream.str(line);
-	sstream >> mapSize.x >> mapSize.y;
+	if (nLayers < 1 || collisionLayer < 0 || collisionLayer >= nLayers)
+	{
+		cout << "Wrong layers in level " << levelFile << endl;
+		return false;
+	}
 
-	// Leer tileSize y blockSize
-	getline(fin, line);
-	sstream.clear();
-	sstream.str(line);
-	sstream >> tileSize >> blockSize;
+	return true;
+}
 
-	// Leer nombre del fichero de tilesheet
+bool TileMap::loadLevel(const string& levelFile, bool loadTilesheet)
+{
+	PROFILE_SCOPE("TileMap::loadLevel");
+	vector<string> layerFiles;
+	string animationFile;
+
+	map = collisionMap = NULL;
+	if (!readLevel(levelFile, layerFiles, collisionLayer, animationFile))
+		return false;
+	nLayers = int(layerFiles.size());
+	// El tilesheet es el de la primera capa, las dems lo comparten
+	for (int layer = 0; layer < nLayers; layer++)
+		if (!loadLayer(layerFiles[layer], layer, loadTilesheet && layer == 0))
+			return false;
+	collisionMap = &map[collisionLayer * mapSize.x * mapSize.y];
+	// Las animaciones slo cambian el dibujo, no las colisiones
+	if (loadTilesheet && !loadAnimations(animationFile))
+		return false;
+
+	return true;
+}
+
+bool TileMap::loadLayer(const string& layerFile, int layer, bool loadTilesheet)
+{
+	AssetCache &assets = AssetCache::instance();
+	LayerHandle handle = assets.loadLayer(layerFile);
+	const TileLayer *tileLayer = assets.get(handle);
+
+	if (tileLayer == NULL)
+		return false;
+	// El fichero se queda en la cach mientras lo use algn mapa
+	layers.push_back(handle);
+	if (loadTilesheet)
+	{
+		Texture *sheet;
+
+		tilesheet = assets.loadTexture(tileLayer->tilesheetFile, TEXTURE_PIXEL_FORMAT_RGBA);
+		sheet = assets.get(tilesheet);
+		if (sheet != NULL)
+		{
+			sheet->setWrapS(GL_CLAMP_TO_EDGE);
+			sheet->setWrapT(GL_CLAMP_TO_EDGE);
+			sheet->setMinFilter(GL_NEAREST);
+			sheet->setMagFilter(GL_NEAREST);
+		}
+	}
+
+	if (layer == 0)
+	{
+		// Los vrtices guardan la posicin en 16 bits
+		if ((max(tileLayer->mapSize.x, tileLayer->mapSize.y) - 1) * tileLayer->tileSize + tileLayer->blockSize > TILEMAP_MAX_COORD)
+		{
+			cout << "Layer " << layerFile << " is too large, positions must fit in 16 bits" << endl;
+			mapSize = glm::ivec2(0);
+			return false;
+		}
+		mapSize = tileLayer->mapSize;
+		tileSize = tileLayer->tileSize;
+		blockSize = tileLayer->blockSize;
+		tilesheetSize = tileLayer->tilesheetSize;
+
+		// Reservar memoria para todas las capas
+		map = new int[nLayers * mapSize.x * mapSize.y];
+	}
+	else if (tileLayer->mapSize != mapSize || tileLayer->tileSize != tileSize || tileLayer->blockSize != blockSize || tileLayer->tilesheetSize != tilesheetSize)
+	{
+		// Las capas se dibujan juntas, tienen que coincidir con la primera
+		cout << "Layer " << layerFile << " does not match the first layer" << endl;
+		return false;
+	}
+	copy(tileLayer->tiles.begin(), tileLayer->tiles.end(), &map[layer * mapSize.x * mapSize.y]);
+
+	return true;
+}
+
+bool TileMap::loadAnimations(const string &animationFile)
+{
+	// Por defecto ningn tile est animado: un solo frame
+	animations.assign(4 * tilesheetSize.x * tilesheetSize.y, 0);
+	for (unsigned int tile = 0; tile < animations.size(); tile += 4)
+		animations[tile] = 1;
+	if (animationFile.empty())
+		return true;
+
+	ifstream fin(animationFile.c_str());
+	if (!fin.is_open())
+	{
+		cout << "Cannot open tile animations " << animationFile << endl;
+		return false;
+	}
+
+	string line;
+	stringstream sstream;
+	int nAnimations;
+
+	// Comprobar encabezado
 	getline(fin, line);
-	sstream.clear();
-	sstream.str(line);
-	sstream >> tilesheetFile;
-	tilesheet.loadFromFile(tilesheetFile, TEXTURE_PIXEL_FORMAT_RGBA);
-	tilesheet.setWrapS(GL_CLAMP_TO_EDGE);
-	tilesheet.setWrapT(GL_CLAMP_TO_EDGE);
-	tilesheet.setMinFilter(GL_NEAREST);
-	tilesheet.setMagFilter(GL_NEAREST);
-
-	// Leer tamao del tilesheet
+	if (line.compare(0, 8, "TILEANIM") != 0)
+	{
+		cout << animationFile << " is not a tile animation file" << endl;
+		return false;
+	}
+
+	// Leer nmero de tiles animados
 	getline(fin, line);
 	sstream.clear();
 	sstream.str(line);
-	sstream >> tilesheetSize.x >> tilesheetSize.y;
-	tileTexSize = glm::vec2(1.f / tilesheetSize.x, 1.f / tilesheetSize.y);
-
-	// Reservar memoria para el mapa
-	map = new int[mapSize.x * mapSize.y];
+	sstream >> nAnimations;
 
-	// Leer el mapa lnea por lnea, esperando valores separados por comas.
-	for (int j = 0; j < mapSize.y; j++)
+	// Cada lnea: tile, nmero de frames, distancia entre frames en el
+	// tilesheet y duracin de la animacin completa en segundos
+	for (int i = 0; i < nAnimations; i++)
 	{
-		getline(fin, line); // Leer una lnea completa del mapa.
-		stringstream lineStream(line);
-		for (int i = 0; i < mapSize.x; i++)
+		int tile = -1, frames = 0, stride = 0;
+		float period = 0.f;
+
+		getline(fin, line);
+		sstream.clear();
+		sstream.str(line);
+		sstream >> tile >> frames >> stride >> period;
+		// Todos los frames tienen que estar dentro del tilesheet
+		if (tile < 1 || frames < 1 || stride < 0 || period * 1000.f < 1.f || period * 1000.f > 65535.f ||
+			tile + (frames - 1) * stride >= tilesheetSize.x * tilesheetSize.y)
 		{
-			int value;
-			lineStream >> value;
-			// Si el valor es -1, se asigna tile vaco (0).
-			if (value == -1)
-				map[j * mapSize.x + i] = 0;
-			else
-				map[j * mapSize.x + i] = value;
-			// Se ignora la coma entre nmeros, excepto tras el ltimo valor de la lnea.
-
-			if (i < mapSize.x - 1)
-			{
-				if (lineStream.peek() == ',')
-					lineStream.ignore();
-			}
+			cout << "Wrong tile animation " << i << " in " << animationFile << endl;
+			return false;
 		}
+		animations[4 * tile] = GLushort(frames);
+		animations[4 * tile + 1] = GLushort(stride);
+		animations[4 * tile + 2] = GLushort(period * 1000.f + 0.5f);
 	}
-
 	fin.close();
+
 	return true;
 }
 
+int TileMap::getAnimatedTileCount() const
+{
+	int count = 0;
+
+	for(unsigned int tile=0; tile<animations.size(); tile+=4)
+		if(animations[tile] > 1)
+			count++;
+
+	return count;
+}
+
+// The sheet may be a region of an atlas page, the shaders get the
+// rectangle it covers
+
+void TileMap::useTilesheet(ShaderProgram &program) const
+{
+	const Texture *sheet = AssetCache::instance().get(tilesheet);
+	glm::vec2 atlasOffset, atlasScale;
+
+	atlasOffset = sheet != NULL ? sheet->atlasCoord(glm::vec2(0.f)) : glm::vec2(0.f);
+	atlasScale = sheet != NULL ? sheet->atlasSize(glm::vec2(1.f)) : glm::vec2(1.f);
+	program.setUniform2f(UNIFORM_TILESHEET_SIZE, float(tilesheetSize.x), float(tilesheetSize.y));
+	program.setUniform4f(UNIFORM_TILESHEET_RECT, atlasOffset.x, atlasOffset.y, atlasScale.x, atlasScale.y);
+	if(sheet != NULL)
+		sheet->use();
+}
+
+void TileMap::useAnimations() const
+{
+	GLState &state = GLState::instance();
+	GLuint sampler;
+
+	state.bindTexture(TILEMAP_ANIMATION_UNIT, animationTexture);
+	// Integer textures cannot be filtered
+	sampler = state.sampler(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+	if(sampler != 0)
+		state.bindSampler(TILEMAP_ANIMATION_UNIT, sampler);
+}
+
 
 void TileMap::prepareArrays(const glm::vec2 &minCoords, ShaderProgram &program)
 {
-	int tile;
-	glm::vec2 posTile, texCoordTile[2], halfTexel;
-	vector<float> vertices;
-	nTiles = 0;
-	halfTexel = glm::vec2(0.5f / tilesheet.width(), 0.5f / tilesheet.height());
-	for(int j=0; j<mapSize.y; j++)
+	PROFILE_SCOPE("TileMap::prepareArrays");
+	vector<TileVertex> vertices;
+	vector<GLushort> indices;
+	vector<thread> workers;
+	atomic<int> nextRow(0);
+	int nWorkers;
+
+	this->minCoords = minCoords;
+	geometryProgram = &program;
+	nChunks = (mapSize + TILEMAP_CHUNK_SIZE - 1) / TILEMAP_CHUNK_SIZE;
+	// loadLayer already checked the size of the map, but its origin moves it
+	glm::vec2 mapMax = minCoords + glm::vec2((mapSize - 1) * tileSize + blockSize);
+	if(min(minCoords.x, minCoords.y) < -TILEMAP_MAX_COORD - 1 || max(mapMax.x, mapMax.y) > TILEMAP_MAX_COORD)
+	{
+		cout << "Map at (" << minCoords.x << ", " << minCoords.y << ") does not fit in 16-bit positions, it will not be drawn as geometry" << endl;
+		nChunks = glm::ivec2(0);
+	}
+	chunkFirst.resize(nChunks.x * nChunks.y);
+	chunkQuads.resize(nChunks.x * nChunks.y);
+	chunkTiles.resize(nChunks.x * nChunks.y);
+
+	// Every chunk knows where its vertices start, so the array is allocated
+	// once and the chunks can be filled at the same time. Only the count of
+	// non-empty tiles, to skip empty chunks, needs to look at the map.
+	nQuads = 0;
+	for(int chunk=0; chunk<nChunks.x * nChunks.y; chunk++)
 	{
-		for(int i=0; i<mapSize.x; i++)
+		glm::ivec2 chunkMin = TILEMAP_CHUNK_SIZE * glm::ivec2(chunk % nChunks.x, chunk / nChunks.x);
+		glm::ivec2 chunkSize = glm::min(chunkMin + TILEMAP_CHUNK_SIZE, mapSize) - chunkMin;
+
+		chunkFirst[chunk] = 4 * nQuads;
+		chunkQuads[chunk] = nLayers * chunkSize.x * chunkSize.y;
+		chunkTiles[chunk] = countChunkTiles(chunk);
+		nQuads += chunkQuads[chunk];
+	}
+	vertices.resize(4 * nQuads);
+
+	// Rows of chunks are handed out to the workers and this thread alike
+	auto buildRows = [&]() {
+		for(int row=nextRow++; row<nChunks.y; row=nextRow++)
+			for(int chunk=row * nChunks.x; chunk<(row + 1) * nChunks.x; chunk++)
+				buildChunk(chunk, vertices.empty() ? NULL : &vertices[chunkFirst[chunk]]);
+	};
+	// Starting a thread costs more than building a few hundred thousand
+	// vertices, small maps are built by this thread alone
+	nWorkers = nQuads < TILEMAP_PARALLEL_QUADS ? 0 : min(int(thread::hardware_concurrency()), nChunks.y) - 1;
+	for(int i=0; i<nWorkers; i++)
+		workers.push_back(thread(buildRows));
+	buildRows();
+	for(unsigned int i=0; i<workers.size(); i++)
+		workers[i].join();
+
+	// Triangles 0-1-2 and 0-2-3 of every quad, shared by all the chunks
+	nIndexedQuads = min(max(nQuads, 1), TILEMAP_MAX_DRAW_QUADS);
+	indices.resize(6 * nIndexedQuads);
+	for(int quad=0; quad<nIndexedQuads; quad++)
+	{
+		GLushort *index = &indices[6 * quad];
+
+		index[0] = GLushort(4 * quad);
+		index[1] = GLushort(4 * quad + 1);
+		index[2] = GLushort(4 * quad + 2);
+		index[3] = GLushort(4 * quad);
+		index[4] = GLushort(4 * quad + 2);
+		index[5] = GLushort(4 * quad + 3);
+	}
+
+	glGenVertexArrays(1, &vao);
+	GLState::instance().bindVertexArray(vao);
+	glGenBuffers(1, &vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TileVertex), vertices.empty() ? NULL : &vertices[0], GL_STATIC_DRAW);
+	glGenBuffers(1, &ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+	posLocation = program.bindVertexAttribute(ATTRIB_POSITION, 2, GL_SHORT, GL_FALSE, sizeof(TileVertex), (void *)offsetof(TileVertex, x));
+	tileLocation = program.bindVertexAttribute(ATTRIB_TILE, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(TileVertex), (void *)offsetof(TileVertex, tile));
+	prepareAnimations();
+}
+
+bool TileMap::prepareLookup(ShaderProgram &program)
+{
+	PROFILE_SCOPE("TileMap::prepareLookup");
+	vector<GLushort> indices(nLayers * mapSize.x * mapSize.y);
+
+	if(blockSize != tileSize)
+	{
+		cout << "Tile lookup needs blockSize == tileSize" << endl;
+		return false;
+	}
+	for(unsigned int i=0; i<indices.size(); i++)
+		indices[i] = GLushort(map[i]);
+
+	glGenTextures(1, &lookupTexture);
+	GLState::instance().bindTextureForUpdate(TILEMAP_LOOKUP_UNIT, lookupTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	// Layers are stacked vertically, layer l starts at row l * mapSize.y
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, mapSize.x, nLayers * mapSize.y, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, &indices[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	// The quad corners come from gl_VertexID, but a vertex array must be bound
+	glGenVertexArrays(1, &lookupVao);
+	lookupProgram = &program;
+	prepareAnimations();
+
+	return true;
+}
+
+// Shared by both modes, uploaded by whichever is prepared first. Tile t
+// is texel t of a single row.
+
+void TileMap::prepareAnimations()
+{
+	if(animationTexture != 0 || animations.empty())
+		return;
+	glGenTextures(1, &animationTexture);
+	GLState::instance().bindTextureForUpdate(TILEMAP_ANIMATION_UNIT, animationTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, GLsizei(animations.size() / 4), 1, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, &animations[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+int TileMap::countChunkTiles(int chunk) const
+{
+	glm::ivec2 chunkMin = TILEMAP_CHUNK_SIZE * glm::ivec2(chunk % nChunks.x, chunk / nChunks.x);
+	glm::ivec2 chunkMax = glm::min(chunkMin + TILEMAP_CHUNK_SIZE, mapSize);
+	int count = 0;
+
+	for(int layer=0; layer<nLayers; layer++)
+	{
+		const int *tiles = &map[layer * mapSize.x * mapSize.y];
+
+		for(int j=chunkMin.y; j<chunkMax.y; j++)
+			for(int i=chunkMin.x; i<chunkMax.x; i++)
+				if(tiles[j * mapSize.x + i] != 0)
+					count++;
+	}
+
+	return count;
+}
+
+// Positions are 16-bit, loadLayer and prepareArrays reject maps that overflow
+
+void TileMap::buildChunk(int chunk, TileVertex *vertices) const
+{
+	glm::ivec2 chunkMin = TILEMAP_CHUNK_SIZE * glm::ivec2(chunk % nChunks.x, chunk / nChunks.x);
+	glm::ivec2 chunkMax = glm::min(chunkMin + TILEMAP_CHUNK_SIZE, mapSize);
+
+	// Back layers first, chunks never overlap so this order is enough.
+	// The quads follow tileSlot().
+	for(int layer=0; layer<nLayers; layer++)
+	{
+		const int *tiles = &map[layer * mapSize.x * mapSize.y];
+
+		for(int j=chunkMin.y; j<chunkMax.y; j++)
 		{
-			tile = map[j * mapSize.x + i];
-			if(tile != 0)
+			for(int i=chunkMin.x; i<chunkMax.x; i++)
 			{
-				// Non-empty tile
-				nTiles++;
-				posTile = glm::vec2(minCoords.x + i * tileSize, minCoords.y + j * tileSize);
-				texCoordTile[0] = glm::vec2(float((tile)%tilesheetSize.x) / tilesheetSize.x, float((tile)/tilesheetSize.x) / tilesheetSize.y);
-				texCoordTile[1] = texCoordTile[0] + tileTexSize;
-				//texCoordTile[0] += halfTexel;
-				//texCoordTile[1] -= halfTexel;
-				// First triangle
-				vertices.push_back(posTile.x); vertices.push_back(posTile.y);
-				vertices.push_back(texCoordTile[0].x); vertices.push_back(texCoordTile[0].y);
-				vertices.push_back(posTile.x + blockSize); vertices.push_back(posTile.y);
-				vertices.push_back(texCoordTile[1].x); vertices.push_back(texCoordTile[0].y);
-				vertices.push_back(posTile.x + blockSize); vertices.push_back(posTile.y + blockSize);
-				vertices.push_back(texCoordTile[1].x); vertices.push_back(texCoordTile[1].y);
-				// Second triangle
-				vertices.push_back(posTile.x); vertices.push_back(posTile.y);
-				vertices.push_back(texCoordTile[0].x); vertices.push_back(texCoordTile[0].y);
-				vertices.push_back(posTile.x + blockSize); vertices.push_back(posTile.y + blockSize);
-				vertices.push_back(texCoordTile[1].x); vertices.push_back(texCoordTile[1].y);
-				vertices.push_back(posTile.x); vertices.push_back(posTile.y + blockSize);
-				vertices.push_back(texCoordTile[0].x); vertices.push_back(texCoordTile[1].y);
+				buildQuad(i, j, tiles[j * mapSize.x + i], vertices);
+				vertices += 4;
 			}
 		}
 	}
+}
 
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
-	glGenBuffers(1, &vbo);
+// Empty cells get a quad with no area, it never produces fragments.
+// The UVs are left to the vertex shader, which also animates the tile.
+
+void TileMap::buildQuad(int i, int j, int tile, TileVertex *vertices) const
+{
+	glm::vec2 posTile;
+	GLshort x0, y0, x1, y1;
+
+	for(int k=0; k<4; k++)
+	{
+		vertices[k].tile = GLushort(tile);
+		vertices[k].corner = GLushort(k);
+	}
+	if(tile == 0)
+	{
+		for(int k=0; k<4; k++)
+			vertices[k].x = vertices[k].y = 0;
+		return;
+	}
+	posTile = glm::vec2(minCoords.x + i * tileSize, minCoords.y + j * tileSize);
+	x0 = GLshort(posTile.x);
+	y0 = GLshort(posTile.y);
+	x1 = GLshort(posTile.x + blockSize);
+	y1 = GLshort(posTile.y + blockSize);
+	vertices[0].x = x0; vertices[0].y = y0;
+	vertices[1].x = x1; vertices[1].y = y0;
+	vertices[2].x = x1; vertices[2].y = y1;
+	vertices[3].x = x0; vertices[3].y = y1;
+}
+
+// Inside its chunk, the quad of a tile comes after the whole chunk of the
+// layers behind it and after the rows of its layer above it
+
+int TileMap::tileSlot(int i, int j, int layer) const
+{
+	glm::ivec2 chunkPos = glm::ivec2(i, j) / TILEMAP_CHUNK_SIZE;
+	glm::ivec2 chunkMin = TILEMAP_CHUNK_SIZE * chunkPos;
+	glm::ivec2 chunkSize = glm::min(chunkMin + TILEMAP_CHUNK_SIZE, mapSize) - chunkMin;
+	int chunk = chunkPos.y * nChunks.x + chunkPos.x;
+
+	return chunkFirst[chunk] / 4 + (layer * chunkSize.y + j - chunkMin.y) * chunkSize.x + i - chunkMin.x;
+}
+
+void TileMap::setTile(int x, int y, int tile)
+{
+	setTile(x, y, tile, collisionLayer);
+}
+
+void TileMap::setTile(int x, int y, int tile, int layer)
+{
+	TileEdit edit;
+	int *cell;
+
+	if(x < 0 || x >= mapSize.x || y < 0 || y >= mapSize.y || layer < 0 || layer >= nLayers)
+		return;
+	cell = &map[(layer * mapSize.y + y) * mapSize.x + x];
+	if(*cell == tile)
+		return;
+	edit.x = x;
+	edit.y = y;
+	edit.layer = layer;
+	edit.tile = tile;
+	edit.previous = *cell;
+	edit.slot = -1;
+	*cell = tile;
+	if(bGraphics)
+	{
+		lock_guard<mutex> guard(editLock);
+		pendingEdits.push_back(edit);
+	}
+}
+
+// Edits of consecutive quads are uploaded together. A tile edited more
+// than once keeps its last edit, the sort keeps edits of the same quad
+// in the order they were made.
+
+void TileMap::uploadEdits()
+{
+	PROFILE_SCOPE("TileMap::uploadEdits");
+	vector<TileEdit> edits;
+	vector<TileVertex> vertices;
+	unsigned int i;
+
+	{
+		lock_guard<mutex> guard(editLock);
+		edits.swap(pendingEdits);
+	}
+	if(edits.empty())
+		return;
+	if(lookupTexture != 0)
+	{
+		GLState::instance().bindTextureForUpdate(TILEMAP_LOOKUP_UNIT, lookupTexture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	}
+	for(i=0; i<edits.size(); i++)
+	{
+		TileEdit &edit = edits[i];
+		int chunk = (edit.y / TILEMAP_CHUNK_SIZE) * nChunks.x + edit.x / TILEMAP_CHUNK_SIZE;
+
+		if(lookupTexture != 0)
+		{
+			GLushort index = GLushort(edit.tile);
+
+			glTexSubImage2D(GL_TEXTURE_2D, 0, edit.x, edit.layer * mapSize.y + edit.y, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_SHORT, &index);
+		}
+		if(vbo == 0)
+			continue;
+		if(edit.previous == 0)
+			chunkTiles[chunk]++;
+		if(edit.tile == 0)
+			chunkTiles[chunk]--;
+		edit.slot = tileSlot(edit.x, edit.y, edit.layer);
+	}
+	if(lookupTexture != 0)
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if(vbo == 0)
+		return;
+
+	stable_sort(edits.begin(), edits.end(), slotOrder);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, 24 * nTiles * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-	posLocation = program.bindVertexAttribute("position", 2, 4*sizeof(float), 0);
-	texCoordLocation = program.bindVertexAttribute("texCoord", 2, 4*sizeof(float), (void *)(2*sizeof(float)));
+	for(i=0; i<edits.size(); )
+	{
+		int first = edits[i].slot, count = 0;
+
+		while(i < edits.size() && edits[i].slot == first + count)
+		{
+			while(i + 1 < edits.size() && edits[i + 1].slot == edits[i].slot)
+				i++;
+			vertices.resize(4 * (count + 1));
+			buildQuad(edits[i].x, edits[i].y, edits[i].tile, &vertices[4 * count]);
+			count++;
+			i++;
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, 4 * first * sizeof(TileVertex), vertices.size() * sizeof(TileVertex), &vertices[0]);
+		vertices.clear();
+	}
+}
+
+bool TileMap::isTileUploaded(int x, int y, int layer) const
+{
+	int tile;
+
+	if(x < 0 || x >= mapSize.x || y < 0 || y >= mapSize.y || layer < 0 || layer >= nLayers)
+		return false;
+	tile = map[(layer * mapSize.y + y) * mapSize.x + x];
+	if(lookupTexture != 0)
+	{
+		vector<GLushort> indices(nLayers * mapSize.x * mapSize.y);
+
+		GLState::instance().bindTextureForUpdate(TILEMAP_LOOKUP_UNIT, lookupTexture);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, &indices[0]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		if(indices[(layer * mapSize.y + y) * mapSize.x + x] != GLushort(tile))
+			return false;
+	}
+	if(vbo != 0 && nChunks.x > 0)
+	{
+		TileVertex expected[4], uploaded[4];
+
+		buildQuad(x, y, tile, expected);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 4 * tileSlot(x, y, layer) * sizeof(TileVertex), sizeof(uploaded), uploaded);
+		if(memcmp(expected, uploaded, sizeof(expected)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool TileMap::slotOrder(const TileEdit &a, const TileEdit &b)
+{
+	return a.slot < b.slot;
 }
 
 // Collision tests for axis aligned bounding boxes.
@@ -175,6 +774,7 @@ void TileMap::prepareArrays(const glm::vec2 &minCoords, ShaderProgram &program)
 
 bool TileMap::collisionMoveLeft(const glm::ivec2 &pos, const glm::ivec2 &size) const
 {
+	PROFILE_SCOPE("TileMap::collisionMoveLeft");
 	int x, y0, y1;
 	
 	x = pos.x / tileSize;
@@ -185,7 +785,7 @@ bool TileMap::collisionMoveLeft(const glm::ivec2 &pos, const glm::ivec2 &size) c
 
 	for(int y=y0; y<=y1; y++)
 	{
-		int tile = map[y * mapSize.x + x];
+		int tile = collisionMap[y * mapSize.x + x];
 		if(std::find(collidableTiles.begin(), collidableTiles.end(), tile) != collidableTiles.end())
 			return true;
 	}
@@ -195,6 +795,7 @@ bool TileMap::collisionMoveLeft(const glm::ivec2 &pos, const glm::ivec2 &size) c
 
 bool TileMap::collisionMoveRight(const glm::ivec2 &pos, const glm::ivec2 &size) const
 {
+	PROFILE_SCOPE("TileMap::collisionMoveRight");
 	int x, y0, y1;
 	
 	x = (pos.x + size.x - 1) / tileSize;
@@ -205,7 +806,7 @@ bool TileMap::collisionMoveRight(const glm::ivec2 &pos, const glm::ivec2 &size)
 
 	for(int y=y0; y<=y1; y++)
 	{
-		int tile = map[y * mapSize.x + x];
+		int tile = collisionMap[y * mapSize.x + x];
 		if(std::find(collidableTiles.begin(), collidableTiles.end(), tile) != collidableTiles.end())
 			return true;
 	}
@@ -215,6 +816,7 @@ bool TileMap::collisionMoveRight(const glm::ivec2 &pos, const glm::ivec2 &size)
 
 bool TileMap::collisionMoveDown(const glm::ivec2 &pos, const glm::ivec2 &size, int *posY) const
 {
+	PROFILE_SCOPE("TileMap::collisionMoveDown");
 	int x0, x1, y;
 	
 	x0 = pos.x / tileSize;
@@ -225,7 +827,7 @@ bool TileMap::collisionMoveDown(const glm::ivec2 &pos, const glm::ivec2 &size, i
 
 	for(int x=x0; x<=x1; x++)
 	{
-		int tile = map[y * mapSize.x + x];
+		int tile = collisionMap[y * mapSize.x + x];
 		if(std::find(collidableTiles.begin(), collidableTiles.end(), tile) != collidableTiles.end())
 		{
 			if(*posY - tileSize * y + size.y <= 6)
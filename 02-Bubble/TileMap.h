@@ -2,15 +2,55 @@
 #define _TILE_MAP_INCLUDE
 
 
+#include <vector>
+#include <mutex>
 #include <glm/glm.hpp>
 #include "Texture.h"
 #include "ShaderProgram.h"
+#include "AssetCache.h"
+
+
+#define TILEMAP_CHUNK_SIZE 16 // Chunks are TILEMAP_CHUNK_SIZE x TILEMAP_CHUNK_SIZE tiles
+#define TILEMAP_MAX_DRAW_QUADS 16384 // 16-bit indices reach 65536 vertices from the base vertex
+#define TILEMAP_PARALLEL_QUADS (1 << 18) // Maps with fewer quads are built by a single thread
+#define TILEMAP_MAX_COORD 32767 // Vertex positions are 16-bit, in pixels
+#define TILEMAP_LOOKUP_UNIT 1 // Texture unit of the tile indices in lookup mode
+#define TILEMAP_ANIMATION_UNIT 2 // Texture unit of the tile animation table
 
 
 // Class Tilemap is capable of loading a tile map from a text file in a very
-// simple format (see level01.txt for an example). With this information
-// it builds a single VBO that contains all tiles. As a result the render
-// method draws the whole map independently of what is visible.
+// simple format (see level01.txt for an example). A level description
+// (see Nivel01.txt) stacks several of these files as layers, drawn from
+// back to front. All layers share size and tilesheet, and collisions are
+// tested against the one the description designates.
+// With this information it builds a single VBO that contains all tiles,
+// stored chunk by chunk and, inside a chunk, layer by layer, so that one
+// draw paints every layer in the right order.
+// Each tile is 4 vertices holding a 16-bit position, the tile index and
+// the corner, the vertex shader (shaders/tiles.vert) computes the UVs.
+// Every chunk shares the same 16-bit index buffer through its base vertex. Every cell
+// of every layer has its own quad, empty cells a degenerate one, so a
+// tile changed by setTile() only rewrites its quad in place.
+// The render method only draws the chunks that overlap the view, so its
+// cost depends on the screen size and not on the size of the level.
+// In lookup mode the tile indices are instead kept in an R16UI texture,
+// layers one below the other, and the visible part of the map is a single
+// quad: the fragment shader (shaders/tilemap.frag) finds the front-most
+// tile under every pixel and samples the tilesheet. Both modes can be
+// prepared and switched at any time.
+// The level description may end with a file of animated tiles: a
+// TILEANIM line, the number of animations and one line per animated tile
+// with its index, its frame count, the distance between frames in the
+// sheet and the period in seconds. The animation of every tile of the
+// sheet is uploaded once to an RGBA16UI texture and both modes pick the
+// frame in the shaders from the frame time, so animated tiles never
+// touch the VBO or the lookup texture.
+
+
+enum TileRenderMode
+{
+	TILEMAP_RENDER_GEOMETRY, TILEMAP_RENDER_LOOKUP
+};
 
 
 class TileMap
@@ -18,38 +58,115 @@ class TileMap
 
 private:
 	TileMap(const string &levelFile, const glm::vec2 &minCoords, ShaderProgram &program);
+	TileMap(const string &levelFile);
 
 public:
 	// Tile maps can only be created inside an OpenGL context
 	static TileMap *createTileMap(const string &levelFile, const glm::vec2 &minCoords, ShaderProgram &program);
+	// Collision only tile map: loads the level but creates no OpenGL resources
+	static TileMap *createTileMap(const string &levelFile);
+	// Starts reading the layers of the level in the background, so creating
+	// the map later finds them parsed. The handles must be released.
+	static void preloadLevel(const string &levelFile, vector<LayerHandle> &handles);
 
 	~TileMap();
 
-	void render() const;
+	// Draws the part of the map inside the rectangle [viewMin, viewMax)
+	void render(const glm::vec2 &viewMin, const glm::vec2 &viewMax) const;
 	void free();
+
+	// Builds the VBO of the whole map (call free() first to rebuild it)
+	void prepareArrays(const glm::vec2 &minCoords, ShaderProgram &program);
+	// Uploads the tile indices for lookup mode (program uses shaders/tilemap.*).
+	// Fails if tiles overlap (blockSize != tileSize).
+	bool prepareLookup(ShaderProgram &program);
+
+	// Lookup mode is only used once prepareLookup succeeded
+	void setRenderMode(TileRenderMode mode) { renderMode = mode; }
+	TileRenderMode getRenderMode() const { return renderMode; }
 	
 	int getTileSize() const { return tileSize; }
+	int getLayerCount() const { return nLayers; }
+	int getAnimatedTileCount() const;
 
 	bool collisionMoveLeft(const glm::ivec2 &pos, const glm::ivec2 &size) const;
 	bool collisionMoveRight(const glm::ivec2 &pos, const glm::ivec2 &size) const;
 	bool collisionMoveDown(const glm::ivec2 &pos, const glm::ivec2 &size, int *posY) const;
 
+	// Changes a tile of the collision layer, or of the given one. Collisions
+	// see it at once, it is drawn after the next uploadEdits(). May be
+	// called by the simulation thread while the map is rendered.
+	void setTile(int x, int y, int tile);
+	void setTile(int x, int y, int tile, int layer);
+	// Render thread, once a frame before render(). Patches the quads and
+	// lookup texels of the tiles changed since the last call.
+	void uploadEdits();
+	// Reads the tile back from the lookup texture and the VBO, true if both
+	// match the map. Slow, meant for checking uploadEdits().
+	bool isTileUploaded(int x, int y, int layer) const;
+
 	glm::ivec2 getMapSize() const { return glm::ivec2(mapSize.x * tileSize, mapSize.y * tileSize); }
 	
 private:
-	bool loadLevel(const string &levelFile);
-	void prepareArrays(const glm::vec2 &minCoords, ShaderProgram &program);
+	// Pixel position, tile index and corner of the quad (0 to 3, clockwise
+	// from the top left one)
+	struct TileVertex
+	{
+		GLshort x, y;
+		GLushort tile, corner;
+	};
+
+	struct TileEdit
+	{
+		int x, y, layer;
+		int tile, previous;
+		int slot;          // Quad of the tile in the VBO
+	};
+
+	static bool readLevel(const string &levelFile, vector<string> &layerFiles, int &collisionLayer, string &animationFile);
+	bool loadLevel(const string &levelFile, bool loadTilesheet);
+	bool loadLayer(const string &layerFile, int layer, bool loadTilesheet);
+	bool loadAnimations(const string &animationFile);
+	void prepareAnimations();
+	void useTilesheet(ShaderProgram &program) const;
+	void useAnimations() const;
+	void renderGeometry(const glm::vec2 &viewMin, const glm::vec2 &viewMax) const;
+	void renderLookup(const glm::vec2 &viewMin, const glm::vec2 &viewMax) const;
+	int countChunkTiles(int chunk) const;
+	void buildChunk(int chunk, TileVertex *vertices) const;
+	void buildQuad(int i, int j, int tile, TileVertex *vertices) const;
+	int tileSlot(int i, int j, int layer) const;
+	static bool slotOrder(const TileEdit &a, const TileEdit &b);
 
 private:
 	GLuint vao;
-	GLuint vbo;
-	GLint posLocation, texCoordLocation;
-	int nTiles;
+	GLuint vbo, ibo;
+	GLuint lookupVao, lookupTexture;
+	GLuint animationTexture;
+	ShaderProgram *geometryProgram, *lookupProgram;
+	TileRenderMode renderMode;
+	GLint posLocation, tileLocation;
+	int nQuads;
+	glm::vec2 minCoords;
+	glm::ivec2 nChunks;
+	int nIndexedQuads;
+	vector<GLint> chunkFirst;     // First vertex of every chunk, row by row
+	vector<GLsizei> chunkQuads;   // Quads of every chunk, one per cell and layer
+	vector<GLsizei> chunkTiles;   // Non-empty tiles of every chunk
+	mutable vector<GLint> drawBase;
+	mutable vector<GLsizei> drawCount;
+	mutable vector<const GLvoid *> drawIndices;
 	glm::ivec2 position, mapSize, tilesheetSize;
 	int tileSize, blockSize;
-	Texture tilesheet;
-	glm::vec2 tileTexSize;
-	int *map;
+	TextureHandle tilesheet;
+	vector<LayerHandle> layers;   // Kept in the AssetCache while the map exists
+	vector<GLushort> animations;  // Frames, stride, period (ms) and 0 for every tile of the sheet
+	int nLayers, collisionLayer;
+	int *map;            // All the layers, one after the other
+	int *collisionMap;   // Tiles of the collision layer, inside map
+	bool bGraphics;      // False for collision only maps, nothing to upload
+	mutex editLock;
+	vector<TileEdit> pendingEdits;   // Made by setTile(), waiting for uploadEdits()
 
 };
 
@@ -0,0 +1,56 @@
+#ifndef _TRIPLE_BUFFER_INCLUDE
+#define _TRIPLE_BUFFER_INCLUDE
+
+
+#include <atomic>
+
+
+// TripleBuffer is a lock-free mailbox between one producer thread and one
+// consumer thread. The producer fills writeBuffer() and publishes it, the
+// consumer picks up the most recent published buffer with update().
+// Neither side ever waits for the other: the three slots are rotated
+// through a single atomic index, and intermediate values the consumer did
+// not pick up in time are simply overwritten.
+
+
+template<class T>
+class TripleBuffer
+{
+
+public:
+	TripleBuffer() : middle(1)
+	{
+		writeIndex = 0;
+		readIndex = 2;
+	}
+
+	// Producer side
+	T &writeBuffer() { return buffers[writeIndex]; }
+
+	void publish()
+	{
+		writeIndex = middle.exchange(writeIndex | NEW_DATA, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Consumer side. Returns true if a new buffer was published since the last call.
+	bool update()
+	{
+		if((middle.load(std::memory_order_relaxed) & NEW_DATA) == 0)
+			return false;
+		readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	const T &readBuffer() const { return buffers[readIndex]; }
+
+private:
+	enum { INDEX_MASK = 3, NEW_DATA = 4 };
+
+	T buffers[3];
+	int writeIndex, readIndex;
+	std::atomic<int> middle;
+
+};
+
+
+#endif // _TRIPLE_BUFFER_INCLUDE
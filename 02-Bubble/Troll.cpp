@@ -2,6 +2,7 @@
 #include <iostream>
 #include <GL/glew.h>
 #include "Troll.h"
+#include "Profiler.h"
 #include "Game.h"
 
 #define JUMP_ANGLE_STEP 4   // Salto ms rpido
@@ -17,12 +18,20 @@ enum TrollAnims
     IDLE, JUMP
 };
 
-void Troll::init(const glm::ivec2& tileMapPos, ShaderProgram& shaderProgram)
+Troll::~Troll()
+{
+    AssetCache::instance().release(spritesheet);
+}
+
+void Troll::init(const glm::ivec2& tileMapPos)
 {
     bJumping = false;
     active = false; // El Troll empieza inactivo hasta que el jugador se acerque
-    spritesheet.loadFromFile("images/SoaringEagleSpritesheet.png", TEXTURE_PIXEL_FORMAT_RGBA);
-    sprite = Sprite::createSprite(glm::ivec2(32, 32), glm::vec2(0.125, 0.125), &spritesheet, &shaderProgram);
+    // En modo headless no hay contexto OpenGL, el sprite solo se anima.
+    // La textura solo se carga la primera vez, el resto de Trolls la comparten
+    if (!Game::instance().isHeadless())
+        spritesheet = AssetCache::instance().loadTexture("images/SoaringEagleSpritesheet.png", TEXTURE_PIXEL_FORMAT_RGBA);
+    sprite = Sprite::createSprite(glm::ivec2(32, 32), glm::vec2(0.125, 0.125), spritesheet);
     sprite->setNumberAnimations(2);
 
     sprite->setAnimationSpeed(IDLE, 8);
@@ -39,8 +48,9 @@ void Troll::init(const glm::ivec2& tileMapPos, ShaderProgram& shaderProgram)
     sprite->setPosition(glm::vec2(float(tileMapDispl.x + posTroll.x), float(tileMapDispl.y + posTroll.y)));
 }
 
-void Troll::update(int deltaTime, const glm::vec2& playerPos)
+void Troll::update(float deltaTime, const glm::vec2& playerPos)
 {
+    PROFILE_SCOPE("Troll::update");
     float distance = glm::distance(playerPos, glm::vec2(spawnPosition));
 
     // **Spawn y Despawn del Troll**
@@ -109,13 +119,7 @@ void Troll::update(int deltaTime, const glm::vec2& playerPos)
         }
     }
 
-    sprite->setPosition(glm::vec2(float(tileMapDispl.x + posTroll.x), float(tileMapDispl.y + posTroll.y)));
-}
-
-void Troll::render()
-{
-    if (active) // Solo se renderiza si est activo
-        sprite->render();
+    sprite->moveTo(glm::vec2(float(tileMapDispl.x + posTroll.x), float(tileMapDispl.y + posTroll.y)));
 }
 
 void Troll::setTileMap(TileMap* tileMap)
@@ -7,12 +7,14 @@
 class Troll
 {
 public:
-    void init(const glm::ivec2& tileMapPos, ShaderProgram& shaderProgram);
-    void update(int deltaTime, const glm::vec2& playerPos);
-    void render();
+    ~Troll();
+
+    void init(const glm::ivec2& tileMapPos);
+    void update(float deltaTime, const glm::vec2& playerPos);
     void setTileMap(TileMap* tileMap);
     void setPosition(const glm::vec2& pos);
     glm::vec2 getPosition() const { return glm::vec2(posTroll); }
+    const Sprite* getSprite() const { return sprite; }
     void activate();   // Activa el Troll (spawnear)
     void deactivate(); // Desactiva el Troll (despawnear)
     bool isActive() const { return active; } // Devuelve si est activo
@@ -22,7 +24,7 @@ private:
     bool active;  // Indica si el Troll est spawneado o no
     glm::ivec2 tileMapDispl, posTroll, spawnPosition; // Guarda la posicin inicial
     int jumpAngle, startY;
-    Texture spritesheet;
+    TextureHandle spritesheet;  // La textura es la misma para todos, la comparte la AssetCache
     Sprite* sprite;
     TileMap* map;
 };
@@ -0,0 +1,143 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "Benchmark.h"
+
+
+using namespace std;
+
+
+static volatile int sink;
+
+
+void doNotOptimize(int value)
+{
+	sink = sink + value;
+}
+
+
+Benchmark::Benchmark(int warmup, int iterations)
+{
+	this->warmup = warmup;
+	this->iterations = iterations > 0 ? iterations : 1;
+}
+
+bool Benchmark::selected(const string &name) const
+{
+	return filter.empty() || name.find(filter) != string::npos;
+}
+
+void Benchmark::skip(const string &name, const string &reason)
+{
+	BenchmarkResult result;
+
+	if(!selected(name))
+		return;
+	result.name = name;
+	result.iterations = result.opsPerIteration = 0;
+	result.min = result.mean = result.stddev = result.p50 = result.p90 = result.p99 = result.max = 0.0;
+	result.skipped = reason;
+	results.push_back(result);
+	cout << name << ": skipped (" << reason << ")" << endl;
+}
+
+// Nearest-rank percentile of sorted samples
+
+static double percentile(const vector<double> &sorted, double p)
+{
+	int rank = int(ceil(p / 100.0 * sorted.size())) - 1;
+
+	return sorted[max(0, min(rank, int(sorted.size()) - 1))];
+}
+
+void Benchmark::addResult(const string &name, int opsPerIteration, vector<double> &samples)
+{
+	BenchmarkResult result;
+	double sum = 0.0, sumSq = 0.0;
+
+	for(unsigned int i=0; i<samples.size(); i++)
+		samples[i] /= opsPerIteration;
+	sort(samples.begin(), samples.end());
+	for(unsigned int i=0; i<samples.size(); i++)
+	{
+		sum += samples[i];
+		sumSq += samples[i] * samples[i];
+	}
+	result.name = name;
+	result.iterations = int(samples.size());
+	result.opsPerIteration = opsPerIteration;
+	result.min = samples.front();
+	result.max = samples.back();
+	result.mean = sum / samples.size();
+	result.stddev = sqrt(max(0.0, sumSq / samples.size() - result.mean * result.mean));
+	result.p50 = percentile(samples, 50.0);
+	result.p90 = percentile(samples, 90.0);
+	result.p99 = percentile(samples, 99.0);
+	results.push_back(result);
+
+	printf("%-40s %12.1f ns/op (p50 %.1f, p90 %.1f, p99 %.1f, min %.1f, max %.1f)\n", name.c_str(),
+		result.mean, result.p50, result.p90, result.p99, result.min, result.max);
+	fflush(stdout);
+}
+
+void Benchmark::printSummary() const
+{
+	int nSkipped = 0;
+
+	for(unsigned int i=0; i<results.size(); i++)
+		if(!results[i].skipped.empty())
+			nSkipped++;
+	cout << results.size() - nSkipped << " cases run, " << nSkipped << " skipped ("
+		 << warmup << " warmup + " << iterations << " timed iterations each)" << endl;
+}
+
+static string jsonString(const string &str)
+{
+	string escaped = "\"";
+
+	for(unsigned int i=0; i<str.size(); i++)
+	{
+		if(str[i] == '"' || str[i] == '\\')
+			escaped += '\\';
+		escaped += str[i];
+	}
+	escaped += '"';
+
+	return escaped;
+}
+
+bool Benchmark::writeJson(const string &filename) const
+{
+	ofstream fout(filename.c_str(), ios::out | ios::trunc);
+
+	if(!fout.is_open())
+	{
+		cout << "Cannot write " << filename << endl;
+		return false;
+	}
+	fout.setf(ios::fixed);
+	fout.precision(2);
+	fout << "{" << endl;
+	fout << "  \"warmup\": " << warmup << "," << endl;
+	fout << "  \"iterations\": " << iterations << "," << endl;
+	fout << "  \"unit\": \"ns/op\"," << endl;
+	fout << "  \"benchmarks\": [";
+	for(unsigned int i=0; i<results.size(); i++)
+	{
+		const BenchmarkResult &r = results[i];
+
+		fout << (i > 0 ? "," : "") << endl << "    {\"name\": " << jsonString(r.name);
+		if(!r.skipped.empty())
+			fout << ", \"skipped\": " << jsonString(r.skipped) << "}";
+		else
+			fout << ", \"iterations\": " << r.iterations << ", \"ops_per_iteration\": " << r.opsPerIteration
+				 << ", \"mean\": " << r.mean << ", \"stddev\": " << r.stddev << ", \"min\": " << r.min
+				 << ", \"p50\": " << r.p50 << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99
+				 << ", \"max\": " << r.max << "}";
+	}
+	fout << endl << "  ]" << endl << "}" << endl;
+
+	return true;
+}
@@ -0,0 +1,80 @@
+#ifndef _BENCHMARK_INCLUDE
+#define _BENCHMARK_INCLUDE
+
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+
+using namespace std;
+
+
+// Statistics of one benchmark case. Times are per operation, in nanoseconds.
+
+struct BenchmarkResult
+{
+	string name;
+	int iterations, opsPerIteration;
+	double min, mean, stddev, p50, p90, p99, max;
+	string skipped; // Reason the case did not run, empty if it ran
+};
+
+
+// Benchmark runs each case a number of warmup iterations that are thrown
+// away and then a fixed number of timed iterations. Every iteration may
+// perform several operations so very cheap calls can still be timed
+// accurately; the reported statistics are divided by that count.
+
+
+class Benchmark
+{
+
+public:
+	Benchmark(int warmup, int iterations);
+
+	// Only cases whose name contains filter run (empty runs everything)
+	void setFilter(const string &filter) { this->filter = filter; }
+	bool selected(const string &name) const;
+
+	template<class Body>
+	void run(const string &name, int opsPerIteration, Body body)
+	{
+		vector<double> samples;
+
+		if(!selected(name))
+			return;
+		for(int i=0; i<warmup; i++)
+			body();
+		samples.reserve(iterations);
+		for(int i=0; i<iterations; i++)
+		{
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			body();
+			samples.push_back(chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+		}
+		addResult(name, opsPerIteration, samples);
+	}
+
+	void skip(const string &name, const string &reason);
+
+	void printSummary() const;
+	bool writeJson(const string &filename) const;
+
+private:
+	void addResult(const string &name, int opsPerIteration, vector<double> &samples);
+
+private:
+	int warmup, iterations;
+	string filter;
+	vector<BenchmarkResult> results;
+
+};
+
+
+// Keeps the compiler from optimizing away results that are never used
+
+void doNotOptimize(int value);
+
+
+#endif // _BENCHMARK_INCLUDE
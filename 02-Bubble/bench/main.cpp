@@ -0,0 +1,440 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#ifdef _WIN32
+#include <direct.h>
+#define chdir _chdir
+#else
+#include <unistd.h>
+#endif
+#include "Benchmark.h"
+#include "../Game.h"
+#include "../TileMap.h"
+#include "../Sprite.h"
+#include "../Troll.h"
+#include "../Shader.h"
+#include "../ShaderProgram.h"
+#include "../AssetCache.h"
+#include "../ImageFile.h"
+#include "../GLState.h"
+
+
+// Micro-benchmarks for the hot paths of the game. Run with --help for options.
+// Paths are relative to the game directory (levels/, shaders/, images/).
+
+#ifndef BENCH_DATA_DIR
+#define BENCH_DATA_DIR "."
+#endif
+
+#define LEVEL_FILE "levels/Nivel01.txt"
+#define ANIMATED_LEVEL_FILE "bench/data/Nivel01.txt" // LEVEL_FILE with animated tiles
+#define STREAMED_IMAGE "images/untitled.png" // Not in the texture atlas
+#define STREAM_BUDGET (16 << 10) // Bytes uploaded per frame, the image takes several
+#define DEFAULT_WARMUP 10
+#define DEFAULT_ITERATIONS 200
+#define N_POSITIONS 4096  // Random boxes per collision iteration
+#define N_SPRITE_UPDATES 1000
+#define N_TROLLS 1024
+#define N_EDITS 64 // Tiles changed before every uploadEdits
+#define RANDOM_SEED 12345 // Fixed so every run tests the same positions
+
+
+// Must run while no map holds the level (not even the one of the game
+// scene), so every iteration parses the layers again instead of finding
+// them in the AssetCache
+
+static void benchLoadLevel(Benchmark &bench)
+{
+	bench.run("TileMap::loadLevel " LEVEL_FILE, 1, []() {
+		TileMap *map = TileMap::createTileMap(LEVEL_FILE);
+
+		doNotOptimize(map->getMapSize().x);
+		delete map;
+		AssetCache::instance().collectUnused();
+	});
+}
+
+static void benchCollisions(Benchmark &bench, TileMap *map)
+{
+	mt19937 random(RANDOM_SEED);
+	glm::ivec2 mapSize = map->getMapSize(), size(32, 32);
+	uniform_int_distribution<int> randomX(0, mapSize.x - size.x - 1), randomY(0, mapSize.y - size.y - 1);
+	vector<glm::ivec2> positions(N_POSITIONS);
+
+	for(unsigned int i=0; i<positions.size(); i++)
+		positions[i] = glm::ivec2(randomX(random), randomY(random));
+
+	bench.run("TileMap::collisionMoveLeft random", N_POSITIONS, [&]() {
+		int nCollisions = 0;
+
+		for(unsigned int i=0; i<positions.size(); i++)
+			nCollisions += map->collisionMoveLeft(positions[i], size) ? 1 : 0;
+		doNotOptimize(nCollisions);
+	});
+	bench.run("TileMap::collisionMoveRight random", N_POSITIONS, [&]() {
+		int nCollisions = 0;
+
+		for(unsigned int i=0; i<positions.size(); i++)
+			nCollisions += map->collisionMoveRight(positions[i], size) ? 1 : 0;
+		doNotOptimize(nCollisions);
+	});
+	bench.run("TileMap::collisionMoveDown random", N_POSITIONS, [&]() {
+		int nCollisions = 0, posY;
+
+		for(unsigned int i=0; i<positions.size(); i++)
+		{
+			posY = positions[i].y;
+			nCollisions += map->collisionMoveDown(positions[i], size, &posY) ? 1 : 0;
+		}
+		doNotOptimize(nCollisions);
+	});
+}
+
+// Large deltaTime values are what a sprite sees after a hitch or when
+// fast-forwarding: the animation has to skip many keyframes at once
+
+static void benchSpriteUpdate(Benchmark &bench)
+{
+	const float deltaTimes[] = { 1000.f / 60.f, 1000.f, 100000.f };
+	char name[64];
+
+	for(unsigned int d=0; d<sizeof(deltaTimes) / sizeof(deltaTimes[0]); d++)
+	{
+		float deltaTime = deltaTimes[d];
+		Sprite *sprite = Sprite::createSprite(glm::ivec2(32, 32), glm::vec2(0.25f, 0.25f), TextureHandle());
+
+		sprite->setNumberAnimations(1);
+		sprite->setAnimationSpeed(0, 8);
+		for(int i=0; i<4; i++)
+			sprite->addKeyframe(0, glm::vec2(0.25f * i, 0.f));
+		sprite->changeAnimation(0);
+
+		snprintf(name, sizeof(name), "Sprite::update dt=%.0fms", deltaTime);
+		bench.run(name, N_SPRITE_UPDATES, [&]() {
+			for(int i=0; i<N_SPRITE_UPDATES; i++)
+				sprite->update(deltaTime);
+			doNotOptimize(int(sprite->getState().texCoordDispl.x * 4.f));
+		});
+		delete sprite;
+	}
+}
+
+// Trolls are spread along the map, each with the player close enough to be
+// active, so every update runs the full chase, jump and collision logic
+
+static void benchTrollUpdate(Benchmark &bench, TileMap *map)
+{
+	vector<Troll> trolls(N_TROLLS);
+	vector<glm::vec2> playerPositions(N_TROLLS);
+	int tileSize = map->getTileSize(), mapWidth = map->getMapSize().x;
+
+	for(int i=0; i<N_TROLLS; i++)
+	{
+		glm::vec2 spawn(float((4 + 8 * i) % (mapWidth - 64)), float(5 * tileSize));
+
+		trolls[i].init(glm::ivec2(0, 0));
+		trolls[i].setPosition(spawn);
+		trolls[i].setTileMap(map);
+		playerPositions[i] = spawn + glm::vec2(64.f, 0.f);
+	}
+	bench.run("Troll::update x1024", N_TROLLS, [&]() {
+		for(int i=0; i<N_TROLLS; i++)
+			trolls[i].update(1000.f / 60.f, playerPositions[i]);
+		doNotOptimize(int(trolls[N_TROLLS - 1].getPosition().y));
+	});
+}
+
+static bool initShaders(ShaderProgram &program, const char *vertexFile, const char *fragmentFile)
+{
+	Shader vShader, fShader;
+
+	vShader.initFromFile(VERTEX_SHADER, vertexFile);
+	fShader.initFromFile(FRAGMENT_SHADER, fragmentFile);
+	if(!vShader.isCompiled() || !fShader.isCompiled())
+		return false;
+	program.init();
+	program.addShader(vShader);
+	program.addShader(fShader);
+	program.link();
+	program.bindFragmentOutput("outColor");
+	vShader.free();
+	fShader.free();
+
+	return program.isLinked();
+}
+
+// Tile changed by edit number edit. Scattered over the map, so the cost of
+// uploadEdits should not depend on the map size.
+
+static void editedTile(const TileMap *map, int edit, glm::ivec2 &tile, int &layer)
+{
+	glm::ivec2 mapTiles = map->getMapSize() / map->getTileSize();
+
+	tile = glm::ivec2((37 * edit) % mapTiles.x, (11 * edit) % mapTiles.y);
+	layer = edit % map->getLayerCount();
+}
+
+static void editTiles(TileMap *map, int &edit)
+{
+	for(int i=0; i<N_EDITS; i++, edit++)
+	{
+		glm::ivec2 tile;
+		int layer;
+
+		editedTile(map, edit, tile, layer);
+		map->setTile(tile.x, tile.y, 1 + edit % 8, layer);
+	}
+}
+
+// Edits once more, outside the timing, and reads the tiles back. The game
+// draws a frame between two uploads, the sprites after the map, which
+// leaves unit 0 active while the lookup texture stays bound.
+
+static bool checkEdits(TileMap *map, int &edit)
+{
+	int first = edit;
+	bool bUploaded = true;
+
+	map->render(glm::vec2(0.f, 0.f), glm::vec2(map->getMapSize()));
+	GLState::instance().bindTextureForUpdate(0, 0);
+	editTiles(map, edit);
+	map->uploadEdits();
+	for(int i=first; i<edit; i++)
+	{
+		glm::ivec2 tile;
+		int layer;
+
+		editedTile(map, i, tile, layer);
+		bUploaded = bUploaded && map->isTileUploaded(tile.x, tile.y, layer);
+	}
+
+	return bUploaded;
+}
+
+static void benchPrepareArrays(Benchmark &bench)
+{
+	const char *createName = "TileMap::createTileMap " ANIMATED_LEVEL_FILE;
+	const char *name = "TileMap::prepareArrays " LEVEL_FILE;
+	const char *editName = "TileMap::uploadEdits 64 tiles";
+	const char *lookupEditName = "TileMap::uploadEdits 64 tiles with lookup";
+	ShaderProgram program, lookupProgram;
+	TileMap *map;
+	int edit = 0, nAnimated = 0;
+
+	auto uploadEdits = [&]() {
+		editTiles(map, edit);
+		map->uploadEdits();
+		glFinish();
+	};
+
+	if(!initShaders(program, "shaders/tiles.vert", "shaders/texture.frag") ||
+	   !initShaders(lookupProgram, "shaders/tilemap.vert", "shaders/tilemap.frag"))
+	{
+		bench.skip(createName, "shaders failed to build");
+		bench.skip(name, "shaders failed to build");
+		bench.skip(editName, "shaders failed to build");
+		bench.skip(lookupEditName, "shaders failed to build");
+	}
+	else
+	{
+		// Everything a graphics map loads: the tilesheet, the animation table
+		// and its texture, and the VBO. The layers come from the AssetCache,
+		// the game scene holds them. No level of the game animates its tiles
+		// yet, so the table comes with the benchmark.
+		bench.run(createName, 1, [&]() {
+			map = TileMap::createTileMap(ANIMATED_LEVEL_FILE, glm::vec2(0.f, 0.f), program);
+			nAnimated = map->getAnimatedTileCount();
+			glFinish();
+			map->free();
+			delete map;
+			AssetCache::instance().collectUnused();
+		});
+		if(bench.selected(createName) && nAnimated == 0)
+			printf("%s has no animated tiles\n", ANIMATED_LEVEL_FILE);
+		map = TileMap::createTileMap(LEVEL_FILE, glm::vec2(0.f, 0.f), program);
+		bench.run(name, 1, [&]() {
+			map->free();
+			map->prepareArrays(glm::vec2(0.f, 0.f), program);
+			glFinish();
+		});
+		bench.run(editName, N_EDITS, uploadEdits);
+		if(bench.selected(editName) && !checkEdits(map, edit))
+			printf("%s: the edited tiles were not uploaded\n", editName);
+		// Lookup mode also patches the texture of tile indices
+		if(bench.selected(lookupEditName))
+		{
+			if(!map->prepareLookup(lookupProgram))
+				bench.skip(lookupEditName, "no tile lookup for " LEVEL_FILE);
+			else
+			{
+				map->setRenderMode(TILEMAP_RENDER_LOOKUP);
+				bench.run(lookupEditName, N_EDITS, uploadEdits);
+				if(!checkEdits(map, edit))
+					printf("%s: the edited tiles were not uploaded\n", lookupEditName);
+			}
+		}
+		map->free();
+		delete map;
+		lookupProgram.free();
+		program.free();
+	}
+}
+
+// Streams the image once more, outside the timing, and reads it back. The
+// game draws between two updates, which leaves another texture unit active.
+
+static bool checkStreamedTexture()
+{
+	AssetCache &assets = AssetCache::instance();
+	TextureHandle handle = assets.loadTextureAsync(STREAMED_IMAGE, TEXTURE_PIXEL_FORMAT_RGBA);
+	ImageFile image;
+	vector<unsigned char> pixels;
+	bool bSame;
+
+	while(!assets.isReady(handle) && !assets.isFailed(handle))
+	{
+		assets.update(STREAM_BUDGET);
+		GLState::instance().bindTextureForUpdate(1, 0);
+	}
+	bSame = assets.isReady(handle) && image.load(STREAMED_IMAGE, TEXTURE_PIXEL_FORMAT_RGBA);
+	if(bSame)
+	{
+		const Texture *texture = assets.get(handle);
+
+		pixels.resize(4 * image.size().x * image.size().y);
+		GLState::instance().bindTextureForUpdate(0, texture->id());
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+		bSame = texture->width() == image.size().x && texture->height() == image.size().y && memcmp(&pixels[0], image.pixels(), pixels.size()) == 0;
+	}
+	assets.release(handle);
+	assets.collectUnused();
+
+	return bSame;
+}
+
+// The image is read by the loader threads and streamed through the pixel
+// buffer, STREAM_BUDGET bytes per call to update() as the game would do
+// once a frame. Every iteration loads it from scratch and frees it.
+
+static void benchStreamTexture(Benchmark &bench)
+{
+	const char *name = "AssetCache::loadTextureAsync " STREAMED_IMAGE;
+	AssetCache &assets = AssetCache::instance();
+	bool bLoaded = true;
+
+	bench.run(name, 1, [&]() {
+		TextureHandle handle = assets.loadTextureAsync(STREAMED_IMAGE, TEXTURE_PIXEL_FORMAT_RGBA);
+
+		while(!assets.isReady(handle) && !assets.isFailed(handle))
+			assets.update(STREAM_BUDGET);
+		bLoaded = bLoaded && assets.isReady(handle);
+		glFinish();
+		assets.release(handle);
+		assets.collectUnused();
+	});
+	if(!bLoaded)
+		printf("%s could not be loaded\n", STREAMED_IMAGE);
+	else if(!checkStreamedTexture())
+		printf("%s was streamed with the wrong pixels\n", STREAMED_IMAGE);
+}
+
+// Needs an OpenGL context: a hidden window is created, and the cases are
+// skipped if that fails (e.g. no display on a CI runner without Mesa/Xvfb)
+
+static void benchOpenGL(Benchmark &bench)
+{
+	const char *names[] = { "TileMap::createTileMap " ANIMATED_LEVEL_FILE, "TileMap::prepareArrays " LEVEL_FILE, "TileMap::uploadEdits 64 tiles", "TileMap::uploadEdits 64 tiles with lookup", "AssetCache::loadTextureAsync " STREAMED_IMAGE };
+	const int nNames = sizeof(names) / sizeof(names[0]);
+	GLFWwindow *window;
+	bool bSelected = false;
+
+	for(int i=0; i<nNames; i++)
+		bSelected = bSelected || bench.selected(names[i]);
+	if(!bSelected)
+		return;
+	if(!glfwInit())
+	{
+		for(int i=0; i<nNames; i++)
+			bench.skip(names[i], "glfwInit failed");
+		return;
+	}
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	window = glfwCreateWindow(64, 64, "bench", NULL, NULL);
+	if(!window)
+	{
+		for(int i=0; i<nNames; i++)
+			bench.skip(names[i], "no OpenGL context");
+		glfwTerminate();
+		return;
+	}
+	glfwMakeContextCurrent(window);
+	glewExperimental = GL_TRUE;
+	glewInit();
+	if(bench.selected(names[0]) || bench.selected(names[1]) || bench.selected(names[2]) || bench.selected(names[3]))
+		benchPrepareArrays(bench);
+	benchStreamTexture(bench);
+	AssetCache::instance().free();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+}
+
+static void usage()
+{
+	printf("usage: bench [--warmup N] [--iterations N] [--filter text] [--json file] [--data dir]\n");
+}
+
+
+int main(int argc, char **argv)
+{
+	int warmup = DEFAULT_WARMUP, iterations = DEFAULT_ITERATIONS;
+	const char *jsonFile = NULL, *dataDir = BENCH_DATA_DIR, *filter = "";
+
+	for(int i=1; i<argc; i++)
+	{
+		if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+			warmup = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+			iterations = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+			jsonFile = argv[++i];
+		else if(strcmp(argv[i], "--data") == 0 && i + 1 < argc)
+			dataDir = argv[++i];
+		else
+		{
+			usage();
+			return strcmp(argv[i], "--help") == 0 ? 0 : -1;
+		}
+	}
+	FILE *level = chdir(dataDir) == 0 ? fopen(LEVEL_FILE, "r") : NULL;
+	if(level == NULL)
+	{
+		printf("Cannot find %s in data directory %s\n", LEVEL_FILE, dataDir);
+		return -1;
+	}
+	fclose(level);
+
+	Benchmark bench(warmup, iterations);
+	bench.setFilter(filter);
+	// Before the game scene loads the level and keeps it cached
+	benchLoadLevel(bench);
+
+	// Entities created from here on skip their OpenGL resources
+	Game::instance().init(true);
+	TileMap *map = TileMap::createTileMap(LEVEL_FILE);
+	benchCollisions(bench, map);
+	benchSpriteUpdate(bench);
+	benchTrollUpdate(bench, map);
+	benchOpenGL(bench);
+	bench.printSummary();
+	delete map;
+
+	if(jsonFile != NULL && !bench.writeJson(jsonFile))
+		return -1;
+	return 0;
+}
@@ -1,21 +1,49 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "Game.h"
+#include "FramePacer.h"
+#include "SimulationThread.h"
+#include "ImageFile.h"
+#include "AssetCache.h"
+#include "Profiler.h"
 
 
 #define TARGET_FRAMERATE 60.0f
+#define TICKS_PER_SECOND 60.0     // Fixed simulation rate (gameplay constants are tuned per tick)
+#define MAX_TICKS_PER_FRAME 5     // Catch-up limit, simulation time beyond it is dropped
+#define STATS_INTERVAL 1.0        // Seconds between frame statistics updates in the title
+#define HEADLESS_DEFAULT_TICKS 36000 // Ten minutes of game time
+#define TRACE_DEFAULT_FILE "trace.json" // Written when F9 is pressed
 
 #pragma comment(linker, "/SUBSYSTEM:windows /ENTRY:mainCRTStartup")
 
 
+static const char *traceFile = TRACE_DEFAULT_FILE;
+
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+	/* F9 dumps the profiler zones recorded so far */
+	if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+		PROFILE_DUMP(traceFile);
+	/* F8 switches between drawing the maps as geometry or with tile lookups */
+	if (key == GLFW_KEY_F8 && action == GLFW_PRESS)
+		Game::instance().setTileRenderMode(Game::instance().getTileRenderMode() == TILEMAP_RENDER_GEOMETRY ? TILEMAP_RENDER_LOOKUP : TILEMAP_RENDER_GEOMETRY);
 	if (action == GLFW_PRESS)
 		Game::instance().keyPressed(key);
 	else if (action == GLFW_RELEASE)
 		Game::instance().keyReleased(key);
 }
 
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+	Game::instance().resize(width, height);
+}
+
 void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
 {
 	Game::instance().mouseMove(int(xpos), int(ypos));
@@ -29,11 +57,138 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 		Game::instance().mouseRelease(button);
 }
 
+void show_frame_stats(GLFWwindow* window, const FramePacer &pacer)
+{
+	char title[256];
+	double frameTime = pacer.averageFrameTime();
+	const GpuTimer &gpuTimer = Game::instance().getGpuTimer();
+	int length;
+
+	length = snprintf(title, sizeof(title), "Hello World - %.1f fps, jitter %.2f ms (max %.2f ms), %s tiles",
+		frameTime > 0.0 ? 1.0 / frameTime : 0.0, 1000.0 * pacer.jitter(), 1000.0 * pacer.maxDeviation(),
+		Game::instance().getTileRenderMode() == TILEMAP_RENDER_LOOKUP ? "lookup" : "geometry");
+	/* GPU times are averages of frames read back a few frames late */
+	if (gpuTimer.isSupported())
+		snprintf(title + length, sizeof(title) - length, ", GPU %.2f ms (map %.2f, sprites %.2f)",
+			gpuTimer.frameTime(), gpuTimer.passTime("Map"), gpuTimer.passTime("Sprites"));
+	glfwSetWindowTitle(window, title);
+}
 
-int main(void)
+/* Starts recording and/or replaying input if requested on the command line */
+bool start_input_capture(const char *recordFile, const char *replayFile)
+{
+	if (replayFile != NULL && !Game::instance().startReplay(replayFile))
+	{
+		printf("Cannot open replay %s\n", replayFile);
+		return false;
+	}
+	if (recordFile != NULL && !Game::instance().startRecording(recordFile))
+	{
+		printf("Cannot create recording %s\n", recordFile);
+		return false;
+	}
+	return true;
+}
+
+/* Runs the simulation as fast as possible without a window or OpenGL
+   context and reports the throughput. Used for benchmarks and soak tests. */
+int run_headless(int nTicks, const char *recordFile, const char *replayFile)
+{
+	float deltaTime = float(1000.0 / TICKS_PER_SECOND);
+	int tick;
+
+	PROFILE_THREAD("Simulation");
+	Game::instance().init(true);
+	if (!start_input_capture(recordFile, replayFile))
+		return -1;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (tick = 0; tick < nTicks; tick++)
+	{
+		if (!Game::instance().update(deltaTime))
+			break;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	printf("Simulated %d ticks in %.3f s (%.0f ticks/s, %.2f us/tick)\n", tick, seconds,
+		seconds > 0.0 ? tick / seconds : 0.0, tick > 0 ? 1e6 * seconds / tick : 0.0);
+	return 0;
+}
+
+/* Offline step: writes the baked version of every image given, which the
+   game then maps instead of decoding the PNG. Images are baked as RGBA,
+   the format the game loads them with. */
+int run_bake(int nFiles, char **files)
+{
+	int nBaked = 0;
+
+	for (int i = 0; i < nFiles; i++)
+	{
+		if (ImageFile::bake(files[i], TEXTURE_PIXEL_FORMAT_RGBA))
+		{
+			printf("%s -> %s\n", files[i], ImageFile::bakedName(files[i]).c_str());
+			nBaked++;
+		}
+	}
+	return nBaked == nFiles ? 0 : -1;
+}
+
+
+int main(int argc, char **argv)
 {
 	GLFWwindow* window;
-	double timePerFrame = 1.f / TARGET_FRAMERATE, timePreviousFrame, currentTime;
+	FramePacer pacer;
+	SimulationThread simulation;
+	PacingMode pacingMode = PACING_CAPPED;
+	bool singleThread = false;
+	double timePreviousFrame, currentTime, timeLastStats;
+	double timePerTick = 1.0 / TICKS_PER_SECOND, accumulator = 0.0;
+	int headlessTicks = 0, ticksPerFrame = 0, nTicks;
+	int width, height;
+	const char *recordFile = NULL, *replayFile = NULL;
+	bool traceOnExit = false;
+	TileRenderMode tileRenderMode = TILEMAP_RENDER_GEOMETRY;
+
+	/* Parse command line options */
+	for (int i = 1; i < argc; i++)
+	{
+		/* Everything after --bake is an image to bake */
+		if (strcmp(argv[i], "--bake") == 0)
+			return run_bake(argc - i - 1, argv + i + 1);
+		else if (strcmp(argv[i], "--vsync") == 0)
+			pacingMode = PACING_VSYNC;
+		else if (strcmp(argv[i], "--uncapped") == 0)
+			pacingMode = PACING_UNCAPPED;
+		else if (strcmp(argv[i], "--headless") == 0)
+			headlessTicks = (i + 1 < argc && atoi(argv[i + 1]) > 0) ? atoi(argv[++i]) : HEADLESS_DEFAULT_TICKS;
+		else if (strcmp(argv[i], "--single-thread") == 0)
+			singleThread = true;
+		else if (strcmp(argv[i], "--fast-forward") == 0 && i + 1 < argc)
+			ticksPerFrame = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (strcmp(argv[i], "--tile-lookup") == 0)
+			tileRenderMode = TILEMAP_RENDER_LOOKUP;
+		else if (strcmp(argv[i], "--trace") == 0)
+		{
+			traceOnExit = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				traceFile = argv[++i];
+		}
+	}
+	if (headlessTicks > 0)
+	{
+		int result = run_headless(headlessTicks, recordFile, replayFile);
+
+		if (traceOnExit)
+			PROFILE_DUMP(traceFile);
+		return result;
+	}
+	PROFILE_THREAD("Main");
+	/* Fast-forward ties the number of ticks to the rendered frames */
+	if (ticksPerFrame > 0)
+		singleThread = true;
 
 	/* Initialize the library */
 	if (!glfwInit())
@@ -54,6 +209,7 @@ int main(void)
 
 	/* Set callbacks */
 	glfwSetKeyCallback(window, key_callback);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, cursor_position_callback);
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
 
@@ -63,28 +219,81 @@ int main(void)
 
 	/* Init step of the game loop */
 	Game::instance().init();
-	timePreviousFrame = glfwGetTime();
+	glfwGetFramebufferSize(window, &width, &height);
+	Game::instance().resize(width, height);
+	Game::instance().setTileRenderMode(tileRenderMode);
+	if (!start_input_capture(recordFile, replayFile))
+	{
+		glfwTerminate();
+		return -1;
+	}
+	pacer.init(window, pacingMode, TARGET_FRAMERATE);
+	timePreviousFrame = timeLastStats = glfwGetTime();
+	if (!singleThread)
+		simulation.start(TICKS_PER_SECOND, MAX_TICKS_PER_FRAME);
 
 	/* Loop until the user closes the window */
 	while (!glfwWindowShouldClose(window))
 	{
+		/* Sleep until the next frame is due, then poll for and process events */
+		pacer.waitForNextFrame();
 		currentTime = glfwGetTime();
-		if (currentTime - timePreviousFrame >= timePerFrame)
+
+		if (singleThread)
 		{
-			/* Update & render steps of the game loop */
-			if(!Game::instance().update(int(1000.0f * (currentTime - timePreviousFrame))))
-				glfwSetWindowShouldClose(window, GLFW_TRUE);
-			Game::instance().render();
+			/* Accumulate real time and consume it in fixed simulation ticks.
+			   If the simulation falls behind, several ticks run back to back and the
+			   frames in between are never rendered. The catch-up is bounded so a slow
+			   frame cannot trigger an ever growing number of updates. */
+			accumulator += currentTime - timePreviousFrame;
 			timePreviousFrame = currentTime;
+			if (accumulator > MAX_TICKS_PER_FRAME * timePerTick)
+				accumulator = MAX_TICKS_PER_FRAME * timePerTick;
+
+			/* Fast-forward runs a fixed number of ticks per rendered frame instead */
+			if (ticksPerFrame > 0)
+			{
+				nTicks = ticksPerFrame;
+				accumulator = 0.0;
+			}
+			else
+			{
+				nTicks = int(accumulator / timePerTick);
+				accumulator -= nTicks * timePerTick;
+			}
 
-			/* Swap front and back buffers */
+			/* Update steps of the game loop */
+			for (int i = 0; i < nTicks; i++)
+			{
+				if (!Game::instance().update(float(1000.0 * timePerTick)))
+					glfwSetWindowShouldClose(window, GLFW_TRUE);
+			}
+			if (nTicks > 0)
+				Game::instance().publishSnapshot(currentTime - accumulator);
+		}
+		else if (!simulation.isRunning())
+			glfwSetWindowShouldClose(window, GLFW_TRUE);
+
+		/* Render step, interpolating between the last two ticks of the latest snapshot */
+		Game::instance().render(currentTime);
+
+		/* Swap front and back buffers */
+		{
+			PROFILE_SCOPE("glfwSwapBuffers");
 			glfwSwapBuffers(window);
 		}
 
-		/* Poll for and process events */
-		glfwPollEvents();
+		if (currentTime - timeLastStats >= STATS_INTERVAL)
+		{
+			show_frame_stats(window, pacer);
+			timeLastStats = currentTime;
+		}
 	}
 
+	simulation.stop();
+	if (traceOnExit)
+		PROFILE_DUMP(traceFile);
+	AssetCache::instance().free();
 	glfwTerminate();
 	return 0;
 }
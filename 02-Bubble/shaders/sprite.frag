@@ -0,0 +1,17 @@
+#version 330
+
+uniform sampler2D tex;
+
+in vec2 texCoordFrag;
+in vec4 colorFrag;
+out vec4 outColor;
+
+void main()
+{
+	// Discard fragment if texture sample has alpha < 0.5
+	// otherwise tint the texture sample with the sprite color
+	vec4 texColor = texture(tex, texCoordFrag);
+	if(texColor.a < 0.5f)
+		discard;
+	outColor = colorFrag * texColor;
+}
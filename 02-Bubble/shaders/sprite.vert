@@ -0,0 +1,22 @@
+#version 330
+
+layout(std140) uniform FrameData
+{
+	mat4 projection;
+	vec2 screenSize;
+	float time;
+};
+
+in vec2 position;
+in vec2 texCoord;
+in vec4 color;
+out vec2 texCoordFrag;
+out vec4 colorFrag;
+
+void main()
+{
+	// Sprite batches are already in world coordinates, no modelview needed
+	texCoordFrag = texCoord;
+	colorFrag = color;
+	gl_Position = projection * vec4(position, 0.0, 1.0);
+}
@@ -1,6 +1,13 @@
 #version 330
 
-uniform mat4 projection, modelview;
+layout(std140) uniform FrameData
+{
+	mat4 projection;
+	vec2 screenSize;
+	float time;
+};
+
+uniform mat4 modelview;
 uniform vec2 texCoordDispl;
 
 in vec2 position;
@@ -0,0 +1,57 @@
+#version 330
+
+layout(std140) uniform FrameData
+{
+	mat4 projection;
+	vec2 screenSize;
+	float time;
+};
+
+uniform usampler2D tileMap;  // Layers stacked vertically
+uniform sampler2D tilesheet;
+uniform vec2 tilesheetSize;  // In tiles
+uniform vec4 tilesheetRect;  // Offset and scale of the tilesheet in its atlas page
+uniform int mapLayers;
+uniform usampler2D tileAnimations;  // Frames, stride and period (ms) of every tile
+
+in vec2 mapCoord;
+out vec4 outColor;
+
+// Same as in tiles.vert: an animated tile shows the frame the time is at,
+// frames are stride tiles apart in the tilesheet
+uint animatedTile(uint tile)
+{
+	if(tile >= uint(textureSize(tileAnimations, 0).x))
+		return tile;
+	uvec4 animation = texelFetch(tileAnimations, ivec2(tile, 0), 0);
+	if(animation.x <= 1u)
+		return tile;
+	uint frame = min(uint(fract(time * 1000.0 / float(animation.z)) * float(animation.x)), animation.x - 1u);
+	return tile + frame * animation.y;
+}
+
+void main()
+{
+	int layerRows = textureSize(tileMap, 0).y / mapLayers;
+	uint columns = uint(tilesheetSize.x);
+
+	// Front layer first, the first opaque texel wins. Tile 0 is empty,
+	// otherwise sample the tile the same way the geometry path does
+	// (explicit LOD, derivatives are undefined inside the loop).
+	for(int layer = mapLayers - 1; layer >= 0; layer--)
+	{
+		uint tile = texelFetch(tileMap, ivec2(floor(mapCoord)) + ivec2(0, layer * layerRows), 0).r;
+		if(tile == 0u)
+			continue;
+		tile = animatedTile(tile);
+		vec2 tileCoord = vec2(float(tile % columns), float(tile / columns));
+		vec2 texCoord = (tileCoord + fract(mapCoord)) / tilesheetSize;
+		vec4 texColor = textureLod(tilesheet, tilesheetRect.xy + texCoord * tilesheetRect.zw, 0.0);
+		if(texColor.a >= 0.5f)
+		{
+			outColor = texColor;
+			return;
+		}
+	}
+	discard;
+}
@@ -0,0 +1,25 @@
+#version 330
+
+layout(std140) uniform FrameData
+{
+	mat4 projection;
+	vec2 screenSize;
+	float time;
+};
+
+uniform vec4 quadRect;  // Visible part of the map, in pixels (min, max)
+uniform vec2 mapOrigin;
+uniform int tileSize;
+
+out vec2 mapCoord;
+
+void main()
+{
+	// Triangle strip corners from the vertex index, no vertex buffer needed
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec2 position = mix(quadRect.xy, quadRect.zw, corner);
+
+	// Position in tiles, the integer part selects the tile
+	mapCoord = (position - mapOrigin) / float(tileSize);
+	gl_Position = projection * vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 330
+
+layout(std140) uniform FrameData
+{
+	mat4 projection;
+	vec2 screenSize;
+	float time;
+};
+
+uniform mat4 modelview;
+uniform usampler2D tileAnimations;  // Frames, stride and period (ms) of every tile
+uniform vec2 tilesheetSize;  // In tiles
+uniform vec4 tilesheetRect;  // Offset and scale of the tilesheet in its atlas page
+
+in vec2 position;
+in vec2 tile;  // Index in the tilesheet, and corner of the quad (0 to 3)
+out vec2 texCoordFrag;
+
+// Same as in tilemap.frag: an animated tile shows the frame the time is at,
+// frames are stride tiles apart in the tilesheet
+uint animatedTile(uint tile)
+{
+	if(tile >= uint(textureSize(tileAnimations, 0).x))
+		return tile;
+	uvec4 animation = texelFetch(tileAnimations, ivec2(tile, 0), 0);
+	if(animation.x <= 1u)
+		return tile;
+	uint frame = min(uint(fract(time * 1000.0 / float(animation.z)) * float(animation.x)), animation.x - 1u);
+	return tile + frame * animation.y;
+}
+
+void main()
+{
+	uint index = animatedTile(uint(tile.x));
+	uint corner = uint(tile.y);
+	uint columns = uint(tilesheetSize.x);
+
+	// Corners go clockwise from the top left one
+	vec2 cornerOffset = vec2(float(corner == 1u || corner == 2u), float(corner >= 2u));
+	vec2 tileCoord = vec2(float(index % columns), float(index / columns));
+	vec2 texCoord = (tileCoord + cornerOffset) / tilesheetSize;
+	texCoordFrag = tilesheetRect.xy + texCoord * tilesheetRect.zw;
+	// Transform position from pixel coordinates to clipping coordinates
+	gl_Position = projection * modelview * vec4(position, 0.0, 1.0);
+}